@@ -0,0 +1,110 @@
+#ifndef EX2_ERRORRING_HPP
+#define EX2_ERRORRING_HPP
+
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+#define ERROR_RING_SIZE 64
+#define ERROR_LINE_END "\n"
+
+
+/**
+ * A preallocated ring of library error reports. Pushing is lock-free and async-signal-safe
+ * (no allocation, no iostream, no syscalls), so failing calls never pay for a flushed write.
+ * The reports are written to stderr later with plain write(2) calls.
+ */
+class ErrorRing {
+
+private:
+    struct Entry {
+        std::atomic<unsigned long> seq;
+        const char *prefix;
+        const char *message;
+    };
+
+    Entry entries[ERROR_RING_SIZE];
+
+    std::atomic<unsigned long> head;
+
+    std::atomic<unsigned long> tail;
+
+    std::atomic<unsigned long> dropped;
+
+public:
+    ErrorRing(): entries{}, head(0), tail(0), dropped(0) {}
+
+    /**
+     * Record an error report. Messages must be string literals (they are not copied).
+     * @param prefix
+     * @param message
+     */
+    void push(const char *prefix, const char *message){
+        unsigned long idx = head.fetch_add(1, std::memory_order_relaxed);
+        Entry &entry = entries[idx % ERROR_RING_SIZE];
+        entry.prefix = prefix;
+        entry.message = message;
+        entry.seq.store(idx + 1, std::memory_order_release);
+    }
+
+    /**
+     * @return true iff there are reports that were not written yet.
+     */
+    bool pending() const {
+        return tail.load(std::memory_order_relaxed) != head.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Write every pending report to fd. Reports that were overwritten before being drained are
+     * counted as dropped.
+     * @param fd
+     */
+    void drain(int fd){
+        unsigned long idx = tail.load(std::memory_order_relaxed);
+        unsigned long end = head.load(std::memory_order_acquire);
+        if (end - idx > ERROR_RING_SIZE){
+            dropped.fetch_add(end - idx - ERROR_RING_SIZE, std::memory_order_relaxed);
+            idx = end - ERROR_RING_SIZE;
+        }
+        for (; idx != end; idx++){
+            Entry &entry = entries[idx % ERROR_RING_SIZE];
+            if (entry.seq.load(std::memory_order_acquire) != idx + 1){
+                break;
+            }
+            struct iovec line[3] = {{(void*)entry.prefix, std::strlen(entry.prefix)},
+                                    {(void*)entry.message, std::strlen(entry.message)},
+                                    {(void*)ERROR_LINE_END, 1}};
+            if (writev(fd, line, 3) < 0){
+                break;
+            }
+        }
+        tail.store(idx, std::memory_order_relaxed);
+    }
+
+    /**
+     * @return The number of reports lost because the ring was full.
+     */
+    unsigned long get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+
+/**
+ * Report an unrecoverable system error with async-signal-safe writes and exit the process.
+ * @param prefix
+ * @param message
+ */
+[[noreturn]] inline void fatal_error(const char *prefix, const char *message){
+    struct iovec line[3] = {{(void*)prefix, std::strlen(prefix)}, {(void*)message, std::strlen(message)},
+                            {(void*)ERROR_LINE_END, 1}};
+    if (writev(STDERR_FILENO, line, 3) < 0){
+        _exit(EXIT_FAILURE);
+    }
+    std::exit(EXIT_FAILURE);
+}
+
+
+#endif //EX2_ERRORRING_HPP
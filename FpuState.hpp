@@ -0,0 +1,132 @@
+#ifndef EX2_FPUSTATE_HPP
+#define EX2_FPUSTATE_HPP
+
+
+#include <cpuid.h>
+#include <cstdint>
+#include "Thread.hpp"
+
+
+#define XSAVE_ALIGNMENT 64
+#define FXSAVE_AREA_SIZE 512
+#define CPUID_XSAVE_LEAF 0xD
+#define CPUID_OSXSAVE_BIT (1 << 27)
+
+
+/**
+ * Saves and restores the FP/SSE/AVX state of the threads that are flagged as using it.
+ * Uses XSAVE when the OS enabled it and FXSAVE otherwise. Threads that are not flagged
+ * only get the default MXCSR and x87 control words back when they follow a flagged thread.
+ */
+class FpuState {
+
+private:
+    bool use_xsave;
+
+    uint64_t xsave_mask;
+
+    size_t area_size;
+
+    uint32_t default_mxcsr;
+
+    uint16_t default_fcw;
+
+    bool dirty;
+
+    static char* aligned_area(Thread& thread){
+        auto area = (uintptr_t)thread.fpu_area.data();
+        return (char*)((area + XSAVE_ALIGNMENT - 1) & ~(uintptr_t)(XSAVE_ALIGNMENT - 1));
+    }
+
+    void load_defaults(){
+        asm volatile("ldmxcsr %0" : : "m" (default_mxcsr));
+        asm volatile("fldcw %0" : : "m" (default_fcw));
+    }
+
+public:
+    FpuState(): use_xsave(false), xsave_mask(0), area_size(FXSAVE_AREA_SIZE), default_mxcsr(0),
+                default_fcw(0), dirty(true) {}
+
+    /**
+     * Detect the save format and record the control words of the caller as the defaults.
+     */
+    void init(){
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & CPUID_OSXSAVE_BIT)){
+            uint32_t lo, hi;
+            asm volatile("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+            xsave_mask = ((uint64_t)hi << 32) | lo;
+            __cpuid_count(CPUID_XSAVE_LEAF, 0, eax, ebx, ecx, edx);
+            area_size = ebx;
+            use_xsave = true;
+        }
+        asm volatile("stmxcsr %0" : "=m" (default_mxcsr));
+        asm volatile("fnstcw %0" : "=m" (default_fcw));
+    }
+
+    /**
+     * Flag the thread as (not) using FP/vector state and allocate its save area. Setting the
+     * flag it already has changes nothing (the saved state is kept).
+     * @param thread
+     * @param enabled
+     */
+    void set_enabled(Thread& thread, bool enabled){
+        if (thread.uses_fpu == enabled){
+            return;
+        }
+        thread.uses_fpu = enabled;
+        thread.fpu_saved = false;
+        if (enabled){
+            thread.fpu_area.resize(area_size + XSAVE_ALIGNMENT);
+        } else {
+            std::vector<char>().swap(thread.fpu_area);
+        }
+    }
+
+    /**
+     * Save the state of the outgoing thread if it is flagged.
+     * @param thread
+     */
+    void save(Thread& thread){
+        if (!thread.uses_fpu){
+            return;
+        }
+        char *area = aligned_area(thread);
+        if (use_xsave){
+            asm volatile("xsave64 %0" : "+m" (*area) : "a" ((uint32_t)xsave_mask),
+                         "d" ((uint32_t)(xsave_mask >> 32)) : "memory");
+        } else {
+            asm volatile("fxsave64 %0" : "+m" (*area) : : "memory");
+        }
+        thread.fpu_saved = true;
+    }
+
+    /**
+     * Restore the state of the incoming thread, or the default control words if it has none.
+     * @param thread
+     */
+    void restore(Thread& thread){
+        if (!thread.uses_fpu){
+            if (dirty){
+                load_defaults();
+                dirty = false;
+            }
+            return;
+        }
+        dirty = true;
+        if (!thread.fpu_saved){
+            load_defaults();
+            return;
+        }
+        char *area = aligned_area(thread);
+        if (use_xsave){
+            asm volatile("xrstor64 %0" : : "m" (*area), "a" ((uint32_t)xsave_mask),
+                         "d" ((uint32_t)(xsave_mask >> 32)) : "memory");
+        } else {
+            asm volatile("fxrstor64 %0" : : "m" (*area) : "memory");
+        }
+    }
+};
+
+
+#endif //EX2_FPUSTATE_HPP
@@ -0,0 +1,116 @@
+#ifndef EX2_GROUPQUOTAS_HPP
+#define EX2_GROUPQUOTAS_HPP
+
+
+#include <map>
+#include "Thread.hpp"
+
+
+#define NO_QUOTA 0
+
+
+/**
+ * CPU bandwidth quotas of hierarchical thread groups. Every group may allow its threads (and the
+ * threads of its descendants) to run quota_ns out of every period_ns of CPU time. A group that
+ * used up the quota of itself or of any ancestor is throttled until the period rolls over.
+ */
+class GroupQuotas {
+
+private:
+    struct Group {
+        int parent = NO_GROUP;
+        long quota_ns = NO_QUOTA;
+        long period_ns = 0;
+        long used_ns = 0;
+        long period_start_ns = 0;
+    };
+
+    std::map<int, Group> groups;
+
+    /**
+     * Start a new period for the group if the current one is over.
+     * @param group
+     * @param now_ns
+     */
+    static void roll_period(Group& group, long now_ns){
+        if (group.quota_ns == NO_QUOTA || now_ns - group.period_start_ns < group.period_ns){
+            return;
+        }
+        group.period_start_ns = now_ns - (now_ns - group.period_start_ns) % group.period_ns;
+        group.used_ns = 0;
+    }
+
+public:
+    /**
+     * @param group
+     * @param parent
+     * @return true iff making parent the parent of group does not create a cycle.
+     */
+    bool can_set_parent(int group, int parent) const {
+        for (int ancestor = parent; ancestor != NO_GROUP;){
+            if (ancestor == group){
+                return false;
+            }
+            auto it = groups.find(ancestor);
+            ancestor = it == groups.end() ? NO_GROUP : it->second.parent;
+        }
+        return true;
+    }
+
+    void set_parent(int group, int parent){ groups[group].parent = parent; }
+
+    /**
+     * @param group
+     * @param quota_ns NO_QUOTA to remove the quota.
+     * @param period_ns
+     * @param now_ns
+     */
+    void set_quota(int group, long quota_ns, long period_ns, long now_ns){
+        Group& g = groups[group];
+        g.quota_ns = quota_ns;
+        g.period_ns = period_ns;
+        g.used_ns = 0;
+        g.period_start_ns = now_ns;
+    }
+
+    /**
+     * Charge CPU time to the group and all its ancestors.
+     * @param group
+     * @param ran_ns
+     * @param now_ns
+     */
+    void charge(int group, long ran_ns, long now_ns){
+        while (group != NO_GROUP){
+            auto it = groups.find(group);
+            if (it == groups.end()){
+                return;
+            }
+            roll_period(it->second, now_ns);
+            it->second.used_ns += ran_ns;
+            group = it->second.parent;
+        }
+    }
+
+    /**
+     * @param group
+     * @param now_ns
+     * @return true iff the group or one of its ancestors used up its quota in the current period.
+     */
+    bool throttled(int group, long now_ns){
+        while (group != NO_GROUP){
+            auto it = groups.find(group);
+            if (it == groups.end()){
+                return false;
+            }
+            roll_period(it->second, now_ns);
+            if (it->second.quota_ns != NO_QUOTA && it->second.used_ns >= it->second.quota_ns){
+                return true;
+            }
+            group = it->second.parent;
+        }
+        return false;
+    }
+};
+
+
+#endif //EX2_GROUPQUOTAS_HPP
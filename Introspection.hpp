@@ -0,0 +1,225 @@
+#ifndef EX2_INTROSPECTION_HPP
+#define EX2_INTROSPECTION_HPP
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "uthreads.h"
+
+
+#define INTROSPECTION_MAGIC 0x75746f70U
+#define INTROSPECTION_VERSION 1U
+#define INTROSPECTION_NAME_FORMAT "/uthreads.%d"
+#define INTROSPECTION_NAME_SIZE 32
+#define NO_THREAD_STATE -1
+
+
+/**
+ * The published state of one thread.
+ */
+struct IntrospectionThread {
+    std::atomic<int> state;
+    std::atomic<int> quantums;
+    std::atomic<long> cpu_time_ns;
+    std::atomic<int> wait_reason;
+};
+
+/**
+ * The layout of the shared-memory object, shared by the library (the only writer) and readers in
+ * other processes. Every update is bracketed by the sequence counter (a seqlock): it is odd while
+ * an update is in progress, and a reader retries if it changed while the reader copied the page.
+ */
+struct IntrospectionPage {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    int32_t max_threads;
+    std::atomic<unsigned long> sequence;
+    std::atomic<int> running;
+    std::atomic<long> total_quantums;
+    IntrospectionThread threads[MAX_THREAD_NUM];
+};
+
+/**
+ * A consistent copy of the page, read by Introspection::read.
+ */
+struct IntrospectionSnapshot {
+    int running;
+    long total_quantums;
+    struct uthread_info threads[MAX_THREAD_NUM];
+};
+
+
+/**
+ * Live introspection of the library through a POSIX shared-memory object named after the process
+ * (/uthreads.<pid>), which a tool such as uthread-top maps read-only. The library publishes each
+ * thread's state when it changes and the running thread on every switch; an update is a few
+ * relaxed stores between two stores of the sequence counter.
+ */
+class Introspection {
+
+private:
+    IntrospectionPage *page;
+
+    char name[INTROSPECTION_NAME_SIZE];
+
+    static void format_name(char name[INTROSPECTION_NAME_SIZE], int pid){
+        std::snprintf(name, INTROSPECTION_NAME_SIZE, INTROSPECTION_NAME_FORMAT, pid);
+    }
+
+public:
+    Introspection(): page(nullptr), name{} {}
+
+    /**
+     * Create the shared-memory object of the process and map it.
+     * @return false if the object can't be created or mapped.
+     */
+    bool open(){
+        format_name(name, getpid());
+        int fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if (fd < 0){
+            return false;
+        }
+        void *mapped = MAP_FAILED;
+        if (ftruncate(fd, sizeof(IntrospectionPage)) == 0){
+            mapped = mmap(nullptr, sizeof(IntrospectionPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (mapped == MAP_FAILED){
+            shm_unlink(name);
+            return false;
+        }
+        page = new (mapped) IntrospectionPage();
+        page->pid = getpid();
+        page->max_threads = MAX_THREAD_NUM;
+        page->running = NO_THREAD_STATE;
+        for (IntrospectionThread& thread : page->threads){
+            thread.state = NO_THREAD_STATE;
+        }
+        page->version = INTROSPECTION_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        page->magic = INTROSPECTION_MAGIC;
+        return true;
+    }
+
+    /**
+     * Unmap and remove the shared-memory object (if open).
+     */
+    void close(){
+        if (page == nullptr){
+            return;
+        }
+        munmap(page, sizeof(IntrospectionPage));
+        shm_unlink(name);
+        page = nullptr;
+    }
+
+    bool active() const { return page != nullptr; }
+
+    /**
+     * Start an update.
+     */
+    void begin(){
+        page->sequence.store(page->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /**
+     * Finish an update.
+     */
+    void end(){
+        page->sequence.store(page->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * Publish a thread (inside an update).
+     * @param info The thread's description, or a state of NO_THREAD_STATE for an unused id.
+     */
+    void publish_thread(const struct uthread_info& info){
+        IntrospectionThread& thread = page->threads[info.tid];
+        thread.state.store(info.state, std::memory_order_relaxed);
+        thread.quantums.store(info.quantums, std::memory_order_relaxed);
+        thread.cpu_time_ns.store(info.cpu_time_ns, std::memory_order_relaxed);
+        thread.wait_reason.store(info.wait_reason, std::memory_order_relaxed);
+    }
+
+    /**
+     * Publish a quantum of the running thread (inside an update).
+     * @param id
+     * @param quantums The thread's quantums.
+     * @param total_quantums
+     */
+    void publish_quantum(int id, int quantums, long total_quantums){
+        page->running.store(id, std::memory_order_relaxed);
+        page->threads[id].quantums.store(quantums, std::memory_order_relaxed);
+        page->total_quantums.store(total_quantums, std::memory_order_relaxed);
+    }
+
+    /**
+     * Map the shared-memory object of a process read-only (for readers).
+     * @param pid
+     * @return The page, or nullptr if the process publishes none, the object is too short for a
+     * page, or the layout differs.
+     */
+    static const IntrospectionPage* attach(int pid){
+        char name[INTROSPECTION_NAME_SIZE];
+        format_name(name, pid);
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0){
+            return nullptr;
+        }
+        struct stat object{};
+        if (fstat(fd, &object) < 0 || object.st_size < (off_t)sizeof(IntrospectionPage)){
+            ::close(fd);
+            return nullptr;
+        }
+        void *mapped = mmap(nullptr, sizeof(IntrospectionPage), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED){
+            return nullptr;
+        }
+        auto page = (const IntrospectionPage*)mapped;
+        if (page->magic != INTROSPECTION_MAGIC || page->version != INTROSPECTION_VERSION
+            || page->max_threads != MAX_THREAD_NUM){
+            munmap(mapped, sizeof(IntrospectionPage));
+            return nullptr;
+        }
+        return page;
+    }
+
+    /**
+     * Copy the page (for readers).
+     * @param page
+     * @param snapshot
+     * @return false if the page was updated during the copy (retry).
+     */
+    static bool read(const IntrospectionPage *page, IntrospectionSnapshot& snapshot){
+        unsigned long before = page->sequence.load(std::memory_order_acquire);
+        if (before % 2 != 0){
+            return false;
+        }
+        snapshot.running = page->running.load(std::memory_order_relaxed);
+        snapshot.total_quantums = page->total_quantums.load(std::memory_order_relaxed);
+        for (int tid = 0; tid < MAX_THREAD_NUM; tid++){
+            const IntrospectionThread& thread = page->threads[tid];
+            struct uthread_info& info = snapshot.threads[tid];
+            info.tid = tid;
+            info.state = thread.state.load(std::memory_order_relaxed);
+            info.quantums = thread.quantums.load(std::memory_order_relaxed);
+            info.cpu_time_ns = thread.cpu_time_ns.load(std::memory_order_relaxed);
+            info.wait_reason = thread.wait_reason.load(std::memory_order_relaxed);
+            info.wait_target = -1;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return page->sequence.load(std::memory_order_relaxed) == before;
+    }
+};
+
+
+#endif //EX2_INTROSPECTION_HPP
@@ -0,0 +1,89 @@
+#ifndef EX2_LOGRING_HPP
+#define EX2_LOGRING_HPP
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <sys/uio.h>
+
+
+#define LOG_RING_SIZE (64 * 1024)
+
+
+/**
+ * The worker's log buffer: a byte ring that threads append whole records to, drained with one
+ * writev. Appending never blocks: a record that does not fit is dropped and counted.
+ * The ring is lock-free with one producer and one consumer: the worker appends (with preemption
+ * deferred, so records of different threads don't interleave), and the flusher, which may be
+ * another kernel thread, writes out and consumes. Only one consumer may run at a time.
+ */
+class LogRing {
+
+private:
+    char buffer[LOG_RING_SIZE];
+
+    std::atomic<size_t> head;
+
+    std::atomic<size_t> tail;
+
+    size_t dropped;
+
+public:
+    LogRing(): buffer{}, head(0), tail(0), dropped(0) {}
+
+    /**
+     * Append a record.
+     * @param message
+     * @param len
+     * @return false if the record did not fit and was dropped.
+     */
+    bool append(const char *message, size_t len){
+        size_t curr_head = head.load(std::memory_order_relaxed);
+        if (len > LOG_RING_SIZE - (curr_head - tail.load(std::memory_order_acquire))){
+            dropped++;
+            return false;
+        }
+        size_t start = curr_head % LOG_RING_SIZE;
+        size_t first = len < LOG_RING_SIZE - start ? len : LOG_RING_SIZE - start;
+        std::memcpy(buffer + start, message, first);
+        std::memcpy(buffer, message + first, len - first);
+        head.store(curr_head + len, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @return The number of buffered bytes.
+     */
+    size_t used() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Describe the buffered bytes (up to the end of the ring and the wrapped part) as iovecs.
+     * @param iov Two iovecs.
+     * @return The number of iovecs filled.
+     */
+    int pending(struct iovec iov[2]) const {
+        size_t curr_tail = tail.load(std::memory_order_relaxed);
+        size_t len = head.load(std::memory_order_acquire) - curr_tail;
+        size_t start = curr_tail % LOG_RING_SIZE;
+        size_t first = len < LOG_RING_SIZE - start ? len : LOG_RING_SIZE - start;
+        iov[0] = {(void*)(buffer + start), first};
+        iov[1] = {(void*)buffer, len - first};
+        return len == 0 ? 0 : (len == first ? 1 : 2);
+    }
+
+    /**
+     * Release bytes that were written out.
+     * @param len
+     */
+    void consume(size_t len){
+        tail.store(tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    size_t get_dropped() const { return dropped; }
+};
+
+
+#endif //EX2_LOGRING_HPP
@@ -0,0 +1,36 @@
+#ifndef EX2_PROBES_HPP
+#define EX2_PROBES_HPP
+
+
+/**
+ * USDT (user statically-defined tracing) probes at the scheduling points, in the "uthreads"
+ * provider, for perf and bpftrace (e.g. bpftrace -e 'usdt:./prog:uthreads:switch_in { ... }').
+ * Every probe is a nop instruction plus an ELF note, so a disabled probe costs next to nothing
+ * and nothing is needed at runtime. Without <sys/sdt.h> (systemtap-sdt-dev) at build time the
+ * probes compile to nothing.
+ *
+ * Probes fire once their operation took effect, so a failed or ineffective call fires none.
+ *
+ * Probes and arguments:
+ *   spawn(tid), terminate(tid), block(tid), resume(tid),
+ *   switch_out(tid, total_quantums), switch_in(tid, quantums),
+ *   mutex_wait(tid, holder), mutex_acquire(tid).
+ */
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define UTHREADS_HAVE_SDT
+#endif
+#endif
+
+
+#ifdef UTHREADS_HAVE_SDT
+#define UTHREADS_PROBE1(name, arg1) DTRACE_PROBE1(uthreads, name, arg1)
+#define UTHREADS_PROBE2(name, arg1, arg2) DTRACE_PROBE2(uthreads, name, arg1, arg2)
+#else
+#define UTHREADS_PROBE1(name, arg1) ((void)(arg1))
+#define UTHREADS_PROBE2(name, arg1, arg2) ((void)(arg1), (void)(arg2))
+#endif
+
+
+#endif //EX2_PROBES_HPP
@@ -0,0 +1,83 @@
+#ifndef EX2_RESTARTABLESECTIONS_HPP
+#define EX2_RESTARTABLESECTIONS_HPP
+
+
+#include <ucontext.h>
+#include "Thread.hpp"
+
+
+#define MAX_RESTARTABLE_SECTIONS 32
+#define NO_ABORT 0
+
+
+/**
+ * Registered restartable code ranges (rseq style). When the timer preempts a thread whose
+ * program counter is inside a range, the interrupted context is rewound to the range's abort
+ * handler, so the section is rerun from its start instead of resuming after another thread
+ * touched the same data. Ranges without an abort handler are non-preemptible instead (e.g.
+ * non-reentrant library code): preemption inside them is deferred. A fixed table keeps the
+ * lookup allocation-free in the signal handler.
+ */
+class RestartableSections {
+
+private:
+    struct Section {
+        address_t start;
+        address_t end;
+        address_t abort;
+    };
+
+    Section sections[MAX_RESTARTABLE_SECTIONS];
+
+    int count;
+
+public:
+    RestartableSections(): sections{}, count(0) {}
+
+    /**
+     * @param start First instruction of the section.
+     * @param end One past the last instruction of the section (the commit instruction).
+     * @param abort Where the interrupted context continues if preempted inside the section, or
+     * NO_ABORT for a range in which preemption is deferred.
+     * @return false if the table is full.
+     */
+    bool add(address_t start, address_t end, address_t abort){
+        if (count == MAX_RESTARTABLE_SECTIONS){
+            return false;
+        }
+        sections[count++] = {start, end, abort};
+        return true;
+    }
+
+    /**
+     * If the interrupted program counter is inside a section, move it to the section's abort
+     * handler.
+     * @param context The interrupted context (from an SA_SIGINFO handler).
+     */
+    void rewind(ucontext_t *context) const {
+        auto pc = (address_t)context->uc_mcontext.gregs[REG_RIP];
+        for (int i = 0; i < count; i++){
+            if (sections[i].abort != NO_ABORT && pc >= sections[i].start && pc < sections[i].end){
+                context->uc_mcontext.gregs[REG_RIP] = (greg_t)sections[i].abort;
+                return;
+            }
+        }
+    }
+
+    /**
+     * @param context The interrupted context (from an SA_SIGINFO handler).
+     * @return true iff the interrupted program counter is inside a non-preemptible range.
+     */
+    bool defers(const ucontext_t *context) const {
+        auto pc = (address_t)context->uc_mcontext.gregs[REG_RIP];
+        for (int i = 0; i < count; i++){
+            if (sections[i].abort == NO_ABORT && pc >= sections[i].start && pc < sections[i].end){
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+#endif //EX2_RESTARTABLESECTIONS_HPP
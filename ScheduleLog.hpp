@@ -0,0 +1,205 @@
+#ifndef EX2_SCHEDULELOG_HPP
+#define EX2_SCHEDULELOG_HPP
+
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+
+#define SCHEDULE_LOG_MAGIC "UTSL1"
+#define SCHEDULE_LOG_MAGIC_SIZE 5
+#define SCHEDULE_LOG_BUFFER_SIZE 4096
+#define SCHEDULE_LOG_MAX_RECORD 11
+#define NO_FORCED_THREAD -1
+
+
+/**
+ * A compact binary log of scheduling decisions. Every switch is one record: the quantum index
+ * as a varint delta from the previous record (the first from the quantum recording started at)
+ * followed by one byte of tid. In record mode records are buffered and written with write(2)
+ * (async-signal-safe, the switch may run in the timer handler), in replay mode the whole log is
+ * read up front and decoded one decision ahead, so the scheduler can both pick the recorded
+ * thread and hold off preemption until the recorded quantum (see due).
+ */
+class ScheduleLog {
+
+public:
+    enum Mode { OFF, RECORD, REPLAY };
+
+private:
+    Mode mode;
+
+    int fd;
+
+    unsigned char buffer[SCHEDULE_LOG_BUFFER_SIZE];
+
+    size_t buffered;
+
+    size_t last_quantum;
+
+    std::vector<unsigned char> replay;
+
+    size_t replay_pos;
+
+    size_t pending_quantum;
+
+    int pending_tid;
+
+    size_t divergences;
+
+    bool flush(){
+        bool ok = buffered == 0 || write(fd, buffer, buffered) == (ssize_t)buffered;
+        buffered = 0;
+        return ok;
+    }
+
+    /**
+     * Decode the next replayed record into pending_quantum and pending_tid (NO_FORCED_THREAD at
+     * the end of the log, or on a truncated record).
+     */
+    void decode_next(){
+        size_t delta = 0;
+        unsigned shift = 0;
+        while (replay_pos < replay.size()){
+            unsigned char byte = replay[replay_pos++];
+            delta |= (size_t)(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80)){
+                break;
+            }
+        }
+        if (replay_pos >= replay.size()){
+            pending_tid = NO_FORCED_THREAD;
+            return;
+        }
+        pending_quantum += delta;
+        pending_tid = replay[replay_pos++];
+    }
+
+public:
+    ScheduleLog(): mode(OFF), fd(-1), buffer{}, buffered(0), last_quantum(0), replay_pos(0),
+                   pending_quantum(0), pending_tid(NO_FORCED_THREAD), divergences(0) {}
+
+    Mode get_mode() const { return mode; }
+
+    /**
+     * Start recording to the file at path (truncated).
+     * @param path
+     * @param quantum The current quantum (quanta are recorded relative to it).
+     * @return true on success.
+     */
+    bool start_record(const char *path, size_t quantum){
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0){
+            return false;
+        }
+        std::memcpy(buffer, SCHEDULE_LOG_MAGIC, SCHEDULE_LOG_MAGIC_SIZE);
+        buffered = SCHEDULE_LOG_MAGIC_SIZE;
+        last_quantum = quantum;
+        mode = RECORD;
+        return true;
+    }
+
+    /**
+     * Load the log at path for replay.
+     * @param path
+     * @param quantum The current quantum (the recorded quanta are replayed relative to it).
+     * @return true on success.
+     */
+    bool start_replay(const char *path, size_t quantum){
+        int in = open(path, O_RDONLY | O_CLOEXEC);
+        if (in < 0){
+            return false;
+        }
+        replay.clear();
+        unsigned char chunk[SCHEDULE_LOG_BUFFER_SIZE];
+        ssize_t got;
+        while ((got = read(in, chunk, sizeof(chunk))) > 0){
+            replay.insert(replay.end(), chunk, chunk + got);
+        }
+        close(in);
+        if (got < 0 || replay.size() < SCHEDULE_LOG_MAGIC_SIZE ||
+            std::memcmp(replay.data(), SCHEDULE_LOG_MAGIC, SCHEDULE_LOG_MAGIC_SIZE) != 0){
+            return false;
+        }
+        replay_pos = SCHEDULE_LOG_MAGIC_SIZE;
+        pending_quantum = quantum;
+        decode_next();
+        divergences = 0;
+        mode = REPLAY;
+        return true;
+    }
+
+    /**
+     * Stop recording (flushing the buffer) or replaying.
+     * @return The number of decisions that could not be replayed (0 when recording), or -1 if
+     * writing the log failed.
+     */
+    long stop(){
+        long ret = (long)divergences;
+        if (mode == RECORD){
+            ret = flush() ? 0 : -1;
+            close(fd);
+            fd = -1;
+        }
+        mode = OFF;
+        replay.clear();
+        return ret;
+    }
+
+    /**
+     * Record that tid was switched in at the start of the given quantum.
+     * @param quantum
+     * @param tid
+     */
+    void record(size_t quantum, int tid){
+        if (buffered + SCHEDULE_LOG_MAX_RECORD > SCHEDULE_LOG_BUFFER_SIZE){
+            flush();
+        }
+        size_t delta = quantum - last_quantum;
+        last_quantum = quantum;
+        do {
+            unsigned char byte = delta & 0x7f;
+            delta >>= 7;
+            buffer[buffered++] = delta != 0 ? (byte | 0x80) : byte;
+        } while (delta != 0);
+        buffer[buffered++] = (unsigned char)tid;
+    }
+
+    /**
+     * @param quantum The quantum a switch now would start.
+     * @return false iff the next recorded switch starts a later quantum, so a timer tick now
+     * should not preempt (true once the log is over).
+     */
+    bool due(size_t quantum) const {
+        return pending_tid == NO_FORCED_THREAD || pending_quantum <= quantum;
+    }
+
+    /**
+     * Take the next recorded decision.
+     * @param quantum The quantum the switch starts.
+     * @return The recorded tid, or NO_FORCED_THREAD if the log is over. A decision recorded for
+     * another quantum is counted as a divergence, but still followed.
+     */
+    int next_forced(size_t quantum){
+        int tid = pending_tid;
+        if (tid != NO_FORCED_THREAD){
+            if (pending_quantum != quantum){
+                divergences++;
+            }
+            decode_next();
+        }
+        return tid;
+    }
+
+    /**
+     * Count a recorded decision that could not be followed (its thread was not ready).
+     */
+    void diverged(){ divergences++; }
+};
+
+
+#endif //EX2_SCHEDULELOG_HPP
@@ -0,0 +1,122 @@
+#ifndef EX2_SHAREDSTACK_HPP
+#define EX2_SHAREDSTACK_HPP
+
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "Thread.hpp"
+
+
+#define RESTORER_STACK_SIZE 16384
+#define NO_RESIDENT -1
+
+
+/**
+ * One large stack shared by many threads. Only one thread's frames (the resident) live on it
+ * at a time, the others keep a copy of the used portion in their save buffer. Save buffers are
+ * reserved with the thread, so swapping images in the signal handler never allocates, and only the
+ * pages an image is copied to are ever faulted in.
+ * Both stacks are mapped once and never unmapped: a thread may exit the process while running on
+ * the shared stack, and static destructors must not free it under exit().
+ */
+class SharedStack {
+
+private:
+    char *memory;
+
+    size_t size;
+
+    int resident;
+
+    char *restorer_stack;
+
+    sigjmp_buf restorer_env;
+
+    /**
+     * @param size
+     * @return A fresh read-write mapping of size bytes.
+     */
+    static char* map(size_t size){
+        void *start = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (start == MAP_FAILED){
+            throw std::bad_alloc();
+        }
+        return (char*)start;
+    }
+
+public:
+    SharedStack(): memory(nullptr), size(0), resident(NO_RESIDENT), restorer_stack(nullptr), restorer_env{} {}
+
+    /**
+     * Map the shared stack and the small private stack used for swapping images in.
+     * @param stack_size
+     */
+    void enable(size_t stack_size){
+        memory = map(stack_size);
+        restorer_stack = map(RESTORER_STACK_SIZE);
+        size = stack_size;
+    }
+
+    /**
+     * @return true iff the shared stack was allocated.
+     */
+    bool enabled() const { return size > 0; }
+
+    size_t get_size() const { return size; }
+
+    /**
+     * @return The initial stack pointer of a thread that runs on the shared stack.
+     */
+    address_t top() const { return (address_t)memory + size - sizeof(address_t); }
+
+    /**
+     * @return id of the thread whose frames are currently on the shared stack.
+     */
+    int get_resident() const { return resident; }
+
+    void set_resident(int id){ resident = id; }
+
+    /**
+     * @param thread
+     * @return true iff the thread's frames have to be copied in before jumping to it.
+     */
+    bool needs_restore(const Thread& thread) const {
+        return thread.on_shared_stack && thread.id != resident;
+    }
+
+    /**
+     * Copy the used portion of the shared stack (from the thread's saved stack pointer up)
+     * into the thread's save buffer.
+     * @param thread The resident thread.
+     */
+    void evict(Thread& thread){
+        char *low = std::max((char*)thread.saved_sp, memory);
+        char *high = memory + size;
+        thread.saved_size = high - low;
+        std::memcpy(thread.saved_stack, low, thread.saved_size);
+    }
+
+    /**
+     * Copy the thread's saved image back to the top of the shared stack and make it resident.
+     * @param thread
+     */
+    void load(Thread& thread){
+        std::memcpy(memory + size - thread.saved_size, thread.saved_stack, thread.saved_size);
+        resident = thread.id;
+    }
+
+    /**
+     * Leave the current stack and run restorer on the private restorer stack. Must not return.
+     * @param restorer
+     */
+    void run_on_restorer_stack(EntryPoint restorer){
+        address_t sp = (address_t)restorer_stack + RESTORER_STACK_SIZE - sizeof(address_t);
+        init_env(restorer_env, sp, restorer);
+        siglongjmp(restorer_env, 1);
+    }
+};
+
+
+#endif //EX2_SHAREDSTACK_HPP
@@ -0,0 +1,119 @@
+#ifndef EX2_SLABALLOCATOR_HPP
+#define EX2_SLABALLOCATOR_HPP
+
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+
+#define SLAB_SIZE (64 * 1024)
+#define SLAB_CLASSES 8
+#define SLAB_MIN_BLOCK 16
+#define SLAB_HEADER_SIZE 16
+#define LARGE_BLOCK SLAB_CLASSES
+
+
+/**
+ * A worker-local allocator with power-of-two size classes (16 to 2048 bytes). Blocks are carved
+ * out of 64KB slabs taken from malloc and recycled through per-class free lists, so the common
+ * path is a few pointer operations. Larger requests go to malloc. Every block is preceded by a
+ * 16-byte header holding its class, which keeps the payload 16-byte aligned.
+ * The allocator itself is not reentrant: callers must defer preemption around it.
+ */
+class SlabAllocator {
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    FreeBlock *free_lists[SLAB_CLASSES];
+
+    static int size_class(size_t size){
+        size_t block = SLAB_MIN_BLOCK;
+        for (int i = 0; i < SLAB_CLASSES; i++, block <<= 1){
+            if (size <= block){
+                return i;
+            }
+        }
+        return LARGE_BLOCK;
+    }
+
+    static size_t block_size(int size_class){
+        return SLAB_HEADER_SIZE + ((size_t)SLAB_MIN_BLOCK << size_class);
+    }
+
+    /**
+     * Carve a new slab into free blocks of the class.
+     * @param size_class
+     * @return false if malloc failed.
+     */
+    bool refill(int size_class){
+        auto slab = (char*)std::malloc(SLAB_SIZE);
+        if (slab == nullptr){
+            return false;
+        }
+        size_t size = block_size(size_class);
+        for (size_t offset = 0; offset + size <= SLAB_SIZE; offset += size){
+            auto block = (FreeBlock*)(slab + offset);
+            block->next = free_lists[size_class];
+            free_lists[size_class] = block;
+        }
+        return true;
+    }
+
+public:
+    SlabAllocator(): free_lists{} {}
+
+    /**
+     * @param size
+     * @return A 16-byte aligned block of at least size bytes, or nullptr (errno ENOMEM) if out of
+     * memory or size can't be allocated with a header.
+     */
+    void* allocate(size_t size){
+        int cls = size_class(size);
+        char *block;
+        if (cls == LARGE_BLOCK){
+            if (size > SIZE_MAX - SLAB_HEADER_SIZE){
+                errno = ENOMEM;
+                return nullptr;
+            }
+            block = (char*)std::malloc(SLAB_HEADER_SIZE + size);
+            if (block == nullptr){
+                return nullptr;
+            }
+        } else {
+            if (free_lists[cls] == nullptr && !refill(cls)){
+                return nullptr;
+            }
+            block = (char*)free_lists[cls];
+            free_lists[cls] = free_lists[cls]->next;
+        }
+        *(int*)block = cls;
+        return block + SLAB_HEADER_SIZE;
+    }
+
+    /**
+     * Release a block returned by allocate (nullptr is ignored).
+     * @param ptr
+     */
+    void release(void *ptr){
+        if (ptr == nullptr){
+            return;
+        }
+        char *block = (char*)ptr - SLAB_HEADER_SIZE;
+        int cls = *(int*)block;
+        if (cls == LARGE_BLOCK){
+            std::free(block);
+            return;
+        }
+        auto free_block = (FreeBlock*)block;
+        free_block->next = free_lists[cls];
+        free_lists[cls] = free_block;
+    }
+};
+
+
+#endif //EX2_SLABALLOCATOR_HPP
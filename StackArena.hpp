@@ -0,0 +1,189 @@
+#ifndef EX2_STACKARENA_HPP
+#define EX2_STACKARENA_HPP
+
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+
+
+#define ARENA_REGION_SIZE (2UL * 1024 * 1024)
+#define STACK_ALIGNMENT 64
+#define THP_ENABLED_PATH "/sys/kernel/mm/transparent_hugepage/enabled"
+#define THP_NEVER "[never]"
+#define ANY_NODE -1
+#define NODE_MASK_BITS (8 * sizeof(unsigned long))
+
+
+/**
+ * Prefer the given NUMA node for a page-aligned range of memory.
+ * @param start
+ * @param len
+ * @param node A node below NODE_MASK_BITS.
+ * @param flags mbind flags (e.g. MPOL_MF_MOVE to migrate pages already faulted in).
+ * @return true on success (fails e.g. without NUMA support).
+ */
+inline bool prefer_node(void *start, size_t len, int node, unsigned flags){
+    unsigned long node_mask = 1UL << node;
+    // The kernel reads maxnode - 1 bits of the mask, so the node's bit needs maxnode = node + 2.
+    return syscall(SYS_mbind, start, len, MPOL_PREFERRED, &node_mask, (unsigned long)node + 2, flags) == 0;
+}
+
+
+/**
+ * Carves thread stacks out of 2MB huge-page regions, so switching between threads touches few
+ * TLB entries and the stacks of a program sit next to each other. Regions are backed by
+ * MAP_HUGETLB pages when the system has them reserved, and by transparent huge pages otherwise.
+ * A guard page inside a region would split its huge page, so huge-page regions only have one
+ * guard page, right below the region: an overflow of the lowest stack faults, but the other
+ * stacks of the region overflow into their neighbour. That is the price of the huge pages. Only
+ * when the system has no huge pages at all does every stack get a guard page of its own.
+ * When the worker's NUMA node is known, new regions are bound to it and prefaulted by the worker
+ * (first touch), so stacks never live on a remote node.
+ */
+class StackArena {
+
+private:
+    size_t stack_size;
+
+    size_t slot_size;
+
+    bool guarded;
+
+    int node;
+
+    std::vector<char*> free_stacks;
+
+    /**
+     * Map one more region and split it to free stacks.
+     */
+    void grow(){
+        char *region = map_region();
+        place_on_node(region);
+        size_t slots = ARENA_REGION_SIZE / slot_size;
+        for (size_t i = slots; i > 0; i--){
+            char *slot = region + (i - 1) * slot_size;
+            if (guarded){
+                if (mprotect(slot, page_size(), PROT_NONE) < 0){
+                    throw std::bad_alloc();
+                }
+                slot += page_size();
+            }
+            free_stacks.push_back(slot);
+        }
+    }
+
+    /**
+     * @return A new 2MB region, aligned to a huge page and huge-page backed where possible, with a
+     * guard page right below it.
+     */
+    char* map_region(){
+        void *region = mmap(nullptr, ARENA_REGION_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (region != MAP_FAILED){
+            // Best effort: the page below may already be taken by another mapping.
+            mmap((char*)region - page_size(), page_size(), PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+            return (char*)region;
+        }
+        // Over-map so the region can be aligned to a huge page boundary with a page below it for
+        // the guard, then trim the ends.
+        size_t mapped = 2 * ARENA_REGION_SIZE + page_size();
+        region = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED){
+            throw std::bad_alloc();
+        }
+        char *start = (char*)region;
+        char *aligned = (char*)round_up((size_t)start + page_size(), ARENA_REGION_SIZE);
+        char *guard = aligned - page_size();
+        if (guard > start){
+            munmap(start, guard - start);
+        }
+        munmap(aligned + ARENA_REGION_SIZE, start + mapped - (aligned + ARENA_REGION_SIZE));
+        if (mprotect(guard, page_size(), PROT_NONE) < 0){
+            throw std::bad_alloc();
+        }
+        if (!guarded && (!transparent_huge_pages() || madvise(aligned, ARENA_REGION_SIZE, MADV_HUGEPAGE) < 0)){
+            guarded = true;
+            slot_size = round_up(stack_size, page_size()) + page_size();
+        }
+        return aligned;
+    }
+
+    /**
+     * @return false iff transparent huge pages are disabled (madvise succeeds even then).
+     */
+    static bool transparent_huge_pages(){
+        FILE *file = std::fopen(THP_ENABLED_PATH, "r");
+        if (file == nullptr){
+            return false;
+        }
+        char setting[64] = {0};
+        bool enabled = std::fgets(setting, sizeof(setting), file) != nullptr &&
+                       std::strstr(setting, THP_NEVER) == nullptr;
+        std::fclose(file);
+        return enabled;
+    }
+
+    /**
+     * Prefer the arena's node for the region and fault its pages in from the calling worker.
+     * @param region
+     */
+    void place_on_node(char *region){
+        if (node == ANY_NODE || node >= (int)NODE_MASK_BITS){
+            return;
+        }
+        // A failure (e.g. no NUMA support) leaves the pages to first touch below.
+        prefer_node(region, ARENA_REGION_SIZE, node, 0);
+        for (size_t offset = 0; offset < ARENA_REGION_SIZE; offset += page_size()){
+            region[offset] = 0;
+        }
+    }
+
+    static size_t page_size(){ return (size_t)sysconf(_SC_PAGESIZE); }
+
+    static size_t round_up(size_t size, size_t alignment){
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+public:
+    /**
+     * @param stack_size The size of every stack handed out by the arena.
+     */
+    explicit StackArena(size_t stack_size)
+        : stack_size(stack_size), slot_size(round_up(stack_size, STACK_ALIGNMENT)), guarded(false),
+          node(ANY_NODE) {}
+
+    /**
+     * Place the regions mapped from now on on the given NUMA node.
+     * @param numa_node
+     */
+    void set_node(int numa_node){ node = numa_node; }
+
+    /**
+     * @return A stack of stack_size bytes.
+     */
+    char* allocate(){
+        if (free_stacks.empty()){
+            grow();
+        }
+        char *stack = free_stacks.back();
+        free_stacks.pop_back();
+        return stack;
+    }
+
+    /**
+     * Return a stack to the arena for reuse.
+     * @param stack
+     */
+    void release(char *stack){ free_stacks.push_back(stack); }
+};
+
+
+#endif //EX2_STACKARENA_HPP
@@ -7,8 +7,9 @@
 #include <unistd.h>
 #include <cstddef>
 #include "uthreads.h"
-#include <iostream>
-#include <memory>
+#include "ErrorRing.hpp"
+#include "StackArena.hpp"
+#include <vector>
 
 
 
@@ -16,15 +17,22 @@
 #define ERR_SIG "Error in signal handling."
 #define JB_SP 6
 #define JB_PC 7
+#define NO_GROUP 0
 
-using std::cerr;
-using std::endl;
 using std::size_t;
 
 
 typedef unsigned long address_t;
 typedef void (*EntryPoint)(void);
 
+/**
+ * A cleanup handler registered with uthread_cleanup_push.
+ */
+struct CleanupHandler {
+    void (*routine)(void *);
+    void *arg;
+};
+
 
 
 /* A translation is required when using an address of a variable.
@@ -40,40 +48,109 @@ address_t translate_address(address_t addr)
 }
 
 /**
- * One thread with an env.
+ * Point env at a fresh context that starts executing pc on the stack sp, with the timer signal
+ * blocked: siglongjmp installs the saved mask before it leaves the old stack, so a tick pending
+ * from the switch would otherwise run there, with the new thread already current, and save that
+ * half-done jump as the new thread's context. pc unblocks the signal once on its own stack.
+ * @param env
+ * @param sp Initial stack pointer.
+ * @param pc Entry point of the context.
+ */
+void init_env(sigjmp_buf env, address_t sp, EntryPoint pc)
+{
+    sigsetjmp(env, 1);
+    (env->__jmpbuf)[JB_SP] = translate_address(sp);
+    (env->__jmpbuf)[JB_PC] = translate_address((address_t)pc);
+    if (sigemptyset(&env->__saved_mask) < 0 || sigaddset(&env->__saved_mask, SIGVTALRM) < 0){
+        fatal_error(SYS_ERROR_MSG, ERR_SIG);
+    }
+}
+
+/**
+ * One thread with an env. Control blocks are constructed in place in the thread pool and own
+ * their stack, which is returned to the arena when the block is destroyed.
  */
 class Thread{
 public:
     int id;
     sigjmp_buf env;
-    std::shared_ptr<char> stack;
+    char *stack;
+    StackArena *arena;
     size_t quantums;
+    bool on_shared_stack;
+    address_t saved_sp;
+    char *saved_stack;
+    size_t saved_capacity;
+    size_t saved_size;
+    bool uses_fpu;
+    bool fpu_saved;
+    std::vector<char> fpu_area;
+    int last_error;
+    int group;
+    long cpu_time_ns;
+    int deferral_depth;
+    bool timed_out;
+    bool cancel_requested;
+    std::vector<CleanupHandler> cleanup_handlers;
+    EntryPoint routine;
 
     /**
      * Constructor for a thread (except the main one).
      * @param id
+     * @param stack_arena The arena the thread's stack is allocated from.
      * @param stack_size
      * @param entry_point Entry point of the thread
      */
-    Thread(int id, size_t stack_size,  EntryPoint entry_point)
-        : id(id), env{0}, quantums(0){
-          stack = std::shared_ptr<char>(new char[STACK_SIZE]);
-        address_t sp = (address_t)stack.get() + stack_size - sizeof(address_t);
-        auto pc = (address_t)entry_point;
-        sigsetjmp(env, 1);
-        (env->__jmpbuf)[JB_SP] = translate_address(sp);
-        (env->__jmpbuf)[JB_PC] = translate_address(pc);
-        if (sigemptyset(&env->__saved_mask) < 0){
-            cerr << SYS_ERROR_MSG << SIG_ERR << endl;
-            std::exit(EXIT_FAILURE);
+    Thread(int id, StackArena& stack_arena, size_t stack_size,  EntryPoint entry_point)
+        : id(id), env{0}, stack(stack_arena.allocate()), arena(&stack_arena), quantums(0), on_shared_stack(false), saved_sp(0), saved_stack(nullptr), saved_capacity(0), saved_size(0),
+          uses_fpu(false), fpu_saved(false), last_error(UTHREAD_EOK),
+          group(NO_GROUP), cpu_time_ns(0), deferral_depth(0), timed_out(false), cancel_requested(false), routine(nullptr){
+        address_t sp = (address_t)stack + stack_size - sizeof(address_t);
+        init_env(env, sp, entry_point);
+    }
+
+    /**
+     * Constructor for a thread that runs on the shared stack (no private stack).
+     * @param id
+     * @param entry_point Entry point of the thread
+     * @param shared_sp Top of the shared stack.
+     * @param shared_size Size of the shared stack. The save buffer reserves as much address space
+     * but is not backed by memory: only the pages the thread's images are copied to get faulted in.
+     */
+    Thread(int id, EntryPoint entry_point, address_t shared_sp, size_t shared_size)
+        : id(id), env{0}, stack(nullptr), arena(nullptr), quantums(0), on_shared_stack(true), saved_sp(0),
+          saved_stack(nullptr), saved_capacity(shared_size), saved_size(0),
+          uses_fpu(false), fpu_saved(false), last_error(UTHREAD_EOK),
+          group(NO_GROUP), cpu_time_ns(0), deferral_depth(0), timed_out(false), cancel_requested(false), routine(nullptr){
+        void *buffer = mmap(nullptr, saved_capacity, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (buffer == MAP_FAILED){
+            throw std::bad_alloc();
         }
+        saved_stack = (char*)buffer;
+        init_env(env, shared_sp, entry_point);
     }
 
     /**
      * Constructor for a thread without allocating stack (main thread).
      */
-    explicit Thread(): id(0), env{0}, stack(nullptr), quantums(1) {}
+    explicit Thread()
+        : id(0), env{0}, stack(nullptr), arena(nullptr), quantums(1), on_shared_stack(false), saved_sp(0), saved_stack(nullptr), saved_capacity(0), saved_size(0),
+          uses_fpu(false), fpu_saved(false), last_error(UTHREAD_EOK),
+          group(NO_GROUP), cpu_time_ns(0), deferral_depth(0), timed_out(false), cancel_requested(false), routine(nullptr) {}
 
+    Thread(const Thread&) = delete;
+
+    Thread& operator=(const Thread&) = delete;
+
+    ~Thread(){
+        if (arena != nullptr){
+            arena->release(stack);
+        }
+        if (saved_stack != nullptr){
+            munmap(saved_stack, saved_capacity);
+        }
+    }
 };
 
 
@@ -0,0 +1,104 @@
+#ifndef EX2_THREADPOOL_HPP
+#define EX2_THREADPOOL_HPP
+
+
+#include <new>
+#include <sys/mman.h>
+#include <type_traits>
+#include <utility>
+#include "Thread.hpp"
+
+
+/**
+ * Preallocated storage for the thread control blocks, indexed by thread id. Blocks are
+ * constructed in place when a thread is created and destroyed when it terminates, so creating a
+ * thread never copies a control block or allocates one.
+ */
+class ThreadPool {
+
+private:
+    struct Slot {
+        typename std::aligned_storage<sizeof(Thread), alignof(Thread)>::type storage;
+        bool live;
+    };
+
+    Slot *slots;
+
+    int capacity;
+
+    size_t mapped_size() const { return capacity * sizeof(Slot); }
+
+    Thread* at(int id){ return reinterpret_cast<Thread*>(&slots[id].storage); }
+
+public:
+    /**
+     * @param capacity The number of thread ids.
+     */
+    explicit ThreadPool(int capacity): slots(nullptr), capacity(capacity) {
+        // Mapped (zeroed, so no slot is live) rather than allocated, so the slots can be moved to a NUMA node.
+        void *mapped = mmap(nullptr, mapped_size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED){
+            throw std::bad_alloc();
+        }
+        slots = (Slot*)mapped;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool(){
+        for (int id = 0; id < capacity; id++){
+            destroy(id);
+        }
+        munmap(slots, mapped_size());
+    }
+
+    /**
+     * Move the control blocks to the given NUMA node, including the pages already in use.
+     * @param node
+     * @return true on success (fails e.g. without NUMA support).
+     */
+    bool set_node(int node){
+        return node >= 0 && node < (int)NODE_MASK_BITS && prefer_node(slots, mapped_size(), node, MPOL_MF_MOVE);
+    }
+
+    /**
+     * Construct the control block of the thread with the given id in place.
+     * @param id
+     * @param args The arguments of the Thread constructor.
+     * @return The new control block.
+     */
+    template <typename... Args>
+    Thread& emplace(int id, Args&&... args){
+        Thread *thread = new (at(id)) Thread(std::forward<Args>(args)...);
+        slots[id].live = true;
+        return *thread;
+    }
+
+    /**
+     * Destroy the control block of the thread with the given id (if it exists).
+     * @param id
+     */
+    void destroy(int id){
+        if (contains(id)){
+            slots[id].live = false;
+            at(id)->~Thread();
+        }
+    }
+
+    /**
+     * @param id
+     * @return true iff a thread with the given id exists.
+     */
+    bool contains(int id) const { return id >= 0 && id < capacity && slots[id].live; }
+
+    /**
+     * @param id The id of an existing thread.
+     * @return The control block of the thread.
+     */
+    Thread& operator[](int id){ return *at(id); }
+};
+
+
+#endif //EX2_THREADPOOL_HPP
@@ -2,13 +2,18 @@
 #define EX2_THREADSCOLLECTIONMANAGER_HPP
 
 
-#include <map>
 #include "Thread.hpp"
+#include "StackArena.hpp"
+#include "ThreadPool.hpp"
+#include "GroupQuotas.hpp"
+#include <atomic>
 #include <list>
 #include <set>
 #include <algorithm>
 #include <iostream>
 #include <iterator>
+#include <vector>
+#include <cstdint>
 
 
 #define FAILURE -1
@@ -24,7 +29,9 @@ class ThreadsCollectionManager {
 private:
     int curr_thread_id;
 
-    std::map<int, Thread> threads;
+    StackArena stackArena;
+
+    ThreadPool threads;
 
     std::list<int> readyQueue;
 
@@ -34,8 +41,24 @@ private:
 
     std::set<int> blocked;
 
+    std::vector<int> zombies;
+
+    std::vector<bool> is_zombie;
+
+    std::vector<std::atomic<int>> published_quantums;
+
     size_t stack_size;
 
+    address_t shared_stack_top;
+
+    size_t shared_stack_size;
+
+    GroupQuotas groupQuotas;
+
+    long last_charge_ns;
+
+    int gang_group;
+
 public:
     /**
      * Constructor for initializing the collection manager.
@@ -44,47 +67,105 @@ public:
      * @param stack_size The memory block size for each thread's stack.
      */
     explicit ThreadsCollectionManager(int max_threads, std::size_t stack_size)
-        : curr_thread_id(0), stack_size(stack_size){
+        : curr_thread_id(0), stackArena(stack_size), threads(max_threads), is_zombie(max_threads, false), published_quantums(max_threads), stack_size(stack_size), shared_stack_top(0), shared_stack_size(0),
+          last_charge_ns(0), gang_group(NO_GROUP){
+        zombies.reserve(max_threads);
         for (int i = 1; i < max_threads; i++){
             available_ids.insert(i);
         }
-        threads[curr_thread_id] = Thread();
+        for (std::atomic<int>& quantums : published_quantums){
+            quantums.store(FAILURE, std::memory_order_relaxed);
+        }
+        threads.emplace(curr_thread_id);
     }
 
     /**
      * Create a new thread and add it to the collection and to the ready queue.
      * @param entryPoint A pointer to the function which will be the entry point of the thread.
+     * @param start Where the thread starts running: a trampoline that calls the entry point
+     * (stored as the thread's routine).
      * @return the new thread's id upon success and -1 on failure.
      */
-    int create_thread(EntryPoint entryPoint){
+    int create_thread(EntryPoint entryPoint, EntryPoint start){
+        reap();
         if (available_ids.empty()){
             return FAILURE;
         }
         int new_id = *available_ids.begin();
         available_ids.erase(available_ids.begin());
-        threads[new_id] = Thread(new_id, stack_size, entryPoint);
+        if (shared_stack_top != 0){
+            threads.emplace(new_id, new_id, start, shared_stack_top, shared_stack_size);
+        } else {
+            threads.emplace(new_id, new_id, stackArena, stack_size, start);
+        }
+        threads[new_id].routine = entryPoint;
+        published_quantums[new_id].store(0, std::memory_order_relaxed);
         readyQueue.push_back(new_id);
         return new_id;
     }
 
 
+    /**
+     * Make every thread created from now on run on the shared stack.
+     * @param top Initial stack pointer on the shared stack.
+     * @param size Size of the shared stack.
+     */
+    void use_shared_stack(address_t top, size_t size){
+        shared_stack_top = top;
+        shared_stack_size = size;
+    }
+
+
+    /**
+     * Move the thread control blocks to the given NUMA node and allocate the stacks of threads
+     * created from now on from it.
+     * @param node
+     */
+    void set_node(int node){
+        threads.set_node(node);
+        stackArena.set_node(node);
+    }
+
+
     /**
      * @param id
      * @return true iff a thread with id exists.
      */
-    bool contains(int id){ return threads.count(id) > 0; }
+    bool contains(int id){ return threads.contains(id) && !is_zombie[id]; }
 
 
     /**
-     * Terminate the given thread from every relevant structure
+     * Terminate the given thread from every relevant structure. Its control block and stack are
+     * not freed here (the thread may be terminating itself, still on that stack): the thread
+     * becomes a zombie until the next reap.
      * @param id
      */
     void terminate(int id){
-        threads.erase(id);
         readyQueue.remove(id);
         waiting_fot_mutex.erase(id);
         blocked.erase(id);
-        available_ids.insert(id);
+        zombies.push_back(id);
+        is_zombie[id] = true;
+        published_quantums[id].store(FAILURE, std::memory_order_relaxed);
+    }
+
+
+    /**
+     * Free the control blocks and stacks of the zombies, except the running thread's, and make
+     * their ids available again.
+     */
+    void reap(){
+        auto survivor = zombies.begin();
+        for (int id : zombies){
+            if (id == curr_thread_id){
+                *survivor++ = id;
+                continue;
+            }
+            threads.destroy(id);
+            is_zombie[id] = false;
+            available_ids.insert(id);
+        }
+        zombies.erase(survivor, zombies.end());
     }
 
 
@@ -113,13 +194,25 @@ public:
     void wait_for_mutex(int id){ waiting_fot_mutex.insert(id); }
 
 
+    /**
+     * Remove the thread from the waiting for mutex list (e.g. its wait timed out) and make it
+     * ready unless it is blocked.
+     * @param id
+     */
+    void stop_waiting_for_mutex(int id){
+        waiting_fot_mutex.erase(id);
+        set_as_ready(id);
+    }
+
+
     /**
      * Release a thread which is waiting for the mutex and add it to the
      * ready list.
+     * @return The id of the released thread, or -1 if none is waiting.
      */
-    void advance_mutex_line(){
+    int advance_mutex_line(){
         if (waiting_fot_mutex.empty()){
-            return;
+            return FAILURE;
         }
         std::set<int> waiting_not_blocked;
         std::set_difference(waiting_fot_mutex.begin(), waiting_fot_mutex.end(), blocked.begin(),
@@ -128,9 +221,11 @@ public:
             int id = *waiting_not_blocked.begin();
             readyQueue.push_back(id);
             waiting_fot_mutex.erase(id);
-            return;
+            return id;
         }
+        int id = *waiting_fot_mutex.begin();
         waiting_fot_mutex.erase(waiting_fot_mutex.begin());
+        return id;
     }
 
 
@@ -150,15 +245,93 @@ public:
 
 
     /**
-     * Pop front of ready queue and change it to running
+     * Pop the first ready thread whose group is not throttled (the front if all of them are)
+     * and change it to running. If it starts its group's turn, the other ready members of the
+     * group are moved to the front of the queue so the group runs in consecutive quantums. The
+     * turn lasts until a thread outside the group is picked: members picked during it don't
+     * gather again, or the member just preempted (queued at the back after the pick) would be
+     * pulled straight back and the group would never let other threads run.
      */
     void set_next_thread_as_running(){
-        int id_next = readyQueue.front();
-        readyQueue.pop_front();
+        auto next = std::find_if(readyQueue.begin(), readyQueue.end(),
+                                 [this](int id){ return !is_throttled(id); });
+        if (next == readyQueue.end()){
+            next = readyQueue.begin();
+        }
+        int id_next = *next;
+        readyQueue.erase(next);
         curr_thread_id = id_next;
+        int group = threads[id_next].group;
+        if (group != NO_GROUP && group != gang_group){
+            gather_group(group);
+        }
+        gang_group = group;
+    }
+
+
+    /**
+     * Move the thread to the front of the ready queue.
+     * @param id
+     * @return true iff the thread is in the ready queue.
+     */
+    bool move_to_front(int id){
+        auto it = std::find(readyQueue.begin(), readyQueue.end(), id);
+        if (it == readyQueue.end()){
+            return false;
+        }
+        readyQueue.splice(readyQueue.begin(), readyQueue, it);
+        return true;
+    }
+
+
+    /**
+     * Move a ready thread chosen by random to the front of the ready queue. Threads whose group
+     * is throttled are only chosen if all ready threads are throttled. Runs on every switch, so
+     * the choice is made in place in two passes over the queue, without allocating.
+     * @param random A random number.
+     */
+    void move_random_to_front(uint64_t random){
+        size_t unthrottled = std::count_if(readyQueue.begin(), readyQueue.end(),
+                                           [this](int id){ return !is_throttled(id); });
+        bool any = unthrottled == 0;
+        size_t candidates = any ? readyQueue.size() : unthrottled;
+        if (candidates == 0){
+            return;
+        }
+        size_t chosen = random % candidates;
+        for (auto it = readyQueue.begin(); it != readyQueue.end(); ++it){
+            if ((any || !is_throttled(*it)) && chosen-- == 0){
+                readyQueue.splice(readyQueue.begin(), readyQueue, it);
+                return;
+            }
+        }
     }
 
 
+    /**
+     * Move the ready members of the group to the front of the ready queue (keeping their order).
+     * @param group
+     */
+    void gather_group(int group){
+        std::list<int> members;
+        for (auto it = readyQueue.begin(); it != readyQueue.end();){
+            auto curr = it++;
+            if (threads[*curr].group == group){
+                members.splice(members.end(), readyQueue, curr);
+            }
+        }
+        readyQueue.splice(readyQueue.begin(), members);
+    }
+
+
+    /**
+     * Set the group of the thread with the given id (NO_GROUP to leave its group).
+     * @param id
+     * @param group
+     */
+    void set_group(int id, int group){ threads[id].group = group; }
+
+
     /**
      * @return The running thread.
      */
@@ -170,10 +343,75 @@ public:
      * @return Return a reference to the thread with the given id.
      */
     Thread& get_thread(int id) { return threads[id];}
+
+    /**
+     * Publish the quantum count of the thread for lock-free readers (get_published_quantums).
+     * @param id
+     */
+    void publish_quantums(int id){
+        published_quantums[id].store((int)threads[id].quantums, std::memory_order_relaxed);
+    }
+
+    /**
+     * Read a published quantum count without masking the timer signal.
+     * @param id An id below the maximal number of threads.
+     * @return The count, or FAILURE if no thread with the id exists.
+     */
+    int get_published_quantums(int id) const {
+        return published_quantums[id].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @param id
+     * @return true iff the thread is blocked.
+     */
+    bool is_blocked(int id) const { return blocked.count(id) != 0; }
+
+    /**
+     * @param id
+     * @return true iff the thread waits for the mutex.
+     */
+    bool is_waiting_for_mutex(int id) const { return waiting_fot_mutex.count(id) != 0; }
+
     bool is_someone_waiting(){
         return !readyQueue.empty();
     }
 
+    /**
+     * @return true iff the running thread should be preempted at the end of its quantum: someone
+     * is waiting, and either the running thread is throttled or a waiting thread is not.
+     */
+    bool should_preempt(){
+        if (readyQueue.empty()){
+            return false;
+        }
+        return is_throttled(curr_thread_id) || std::any_of(readyQueue.begin(), readyQueue.end(),
+                                                           [this](int id){ return !is_throttled(id); });
+    }
+
+    /**
+     * Charge the CPU time since the last charge to the running thread and its groups.
+     * @param now_ns
+     */
+    void charge_running_thread(long now_ns){
+        long ran_ns = now_ns - last_charge_ns;
+        Thread& curr = threads[curr_thread_id];
+        curr.cpu_time_ns += ran_ns;
+        groupQuotas.charge(curr.group, ran_ns, now_ns);
+        last_charge_ns = now_ns;
+    }
+
+    /**
+     * @param id
+     * @return true iff the thread's group used up its CPU quota for the current period.
+     */
+    bool is_throttled(int id){ return groupQuotas.throttled(threads[id].group, last_charge_ns); }
+
+    /**
+     * @return The hierarchy and CPU quotas of the thread groups.
+     */
+    GroupQuotas& get_group_quotas(){ return groupQuotas; }
+
     /**
      * Block the thread with the given id.
      * @param id
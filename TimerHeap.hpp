@@ -0,0 +1,119 @@
+#ifndef EX2_TIMERHEAP_HPP
+#define EX2_TIMERHEAP_HPP
+
+
+#include <utility>
+#include <vector>
+
+
+#define NOT_IN_HEAP -1
+
+
+/**
+ * Deadlines of timed waits, one per thread, in a binary min-heap. Every thread's position in
+ * the heap is tracked, so a wait that succeeds before its deadline is cancelled in O(log n).
+ */
+class TimerHeap {
+
+private:
+    struct Timer {
+        long deadline;
+        int id;
+    };
+
+    std::vector<Timer> heap;
+
+    std::vector<int> position;
+
+    void place(size_t index, const Timer& timer){
+        heap[index] = timer;
+        position[timer.id] = (int)index;
+    }
+
+    void sift_up(size_t index){
+        Timer timer = heap[index];
+        while (index > 0 && heap[(index - 1) / 2].deadline > timer.deadline){
+            place(index, heap[(index - 1) / 2]);
+            index = (index - 1) / 2;
+        }
+        place(index, timer);
+    }
+
+    void sift_down(size_t index){
+        Timer timer = heap[index];
+        while (2 * index + 1 < heap.size()){
+            size_t child = 2 * index + 1;
+            if (child + 1 < heap.size() && heap[child + 1].deadline < heap[child].deadline){
+                child++;
+            }
+            if (heap[child].deadline >= timer.deadline){
+                break;
+            }
+            place(index, heap[child]);
+            index = child;
+        }
+        place(index, timer);
+    }
+
+public:
+    /**
+     * @param max_threads The number of thread ids.
+     */
+    explicit TimerHeap(int max_threads): position(max_threads, NOT_IN_HEAP) {
+        heap.reserve(max_threads);
+    }
+
+    /**
+     * Arm (or re-arm) the timer of the thread.
+     * @param id
+     * @param deadline
+     */
+    void add(int id, long deadline){
+        cancel(id);
+        heap.push_back({deadline, id});
+        sift_up(heap.size() - 1);
+    }
+
+    /**
+     * Disarm the timer of the thread, if armed.
+     * @param id
+     */
+    void cancel(int id){
+        int index = position[id];
+        if (index == NOT_IN_HEAP){
+            return;
+        }
+        position[id] = NOT_IN_HEAP;
+        Timer last = heap.back();
+        heap.pop_back();
+        if ((size_t)index == heap.size()){
+            return;
+        }
+        place(index, last);
+        sift_up(index);
+        sift_down(position[last.id]);
+    }
+
+    /**
+     * @param id
+     * @return true iff the timer of the thread is armed.
+     */
+    bool armed(int id) const { return position[id] != NOT_IN_HEAP; }
+
+    /**
+     * Disarm and report every timer whose deadline passed.
+     * @param now
+     * @param expire Called with the id of every expired thread.
+     */
+    template <typename Expire>
+    void expire(long now, Expire expire){
+        while (!heap.empty() && heap.front().deadline <= now){
+            int id = heap.front().id;
+            cancel(id);
+            expire(id);
+        }
+    }
+};
+
+
+#endif //EX2_TIMERHEAP_HPP
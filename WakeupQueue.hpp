@@ -0,0 +1,88 @@
+#ifndef EX2_WAKEUPQUEUE_HPP
+#define EX2_WAKEUPQUEUE_HPP
+
+
+#include <atomic>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "uthreads.h"
+
+
+#define WAKEUP_WORD_BITS 64
+#define WAKEUP_WORDS ((MAX_THREAD_NUM + WAKEUP_WORD_BITS - 1) / WAKEUP_WORD_BITS)
+#define NO_WAKEUP_FD -1
+
+
+/**
+ * Resume requests posted by other kernel threads or by signal handlers.
+ * Producers set the thread's bit with one atomic or (wait-free, async-signal-safe, a thread that
+ * is posted twice before a drain is resumed once). Once an eventfd was created, they also kick it
+ * so an external event loop polling it notices; the library itself never reads the eventfd, its
+ * reader has to. The scheduler drains the set on every switch and tick.
+ */
+class WakeupQueue {
+
+private:
+    std::atomic<uint64_t> pending[WAKEUP_WORDS];
+
+    std::atomic<bool> any_pending;
+
+    std::atomic<int> event_fd;
+
+public:
+    WakeupQueue(): pending{}, any_pending(false), event_fd(NO_WAKEUP_FD) {}
+
+    /**
+     * Create the eventfd that is kicked on every post (if not created yet).
+     * @return true on success.
+     */
+    bool init(){
+        if (event_fd != NO_WAKEUP_FD){
+            return true;
+        }
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return event_fd >= 0;
+    }
+
+    int get_fd() const { return event_fd; }
+
+    /**
+     * Post a resume request for the thread. Safe from any kernel thread and from signal handlers.
+     * @param id
+     */
+    void post(int id){
+        uint64_t bit = (uint64_t)1 << (id % WAKEUP_WORD_BITS);
+        uint64_t old = pending[id / WAKEUP_WORD_BITS].fetch_or(bit, std::memory_order_release);
+        any_pending.store(true, std::memory_order_release);
+        int fd = event_fd.load(std::memory_order_relaxed);
+        if (!(old & bit) && fd >= 0){
+            uint64_t one = 1;
+            if (write(fd, &one, sizeof(one)) < 0){
+                // The counter is saturated, so the fd is readable anyway.
+            }
+        }
+    }
+
+    /**
+     * Call resume for every posted thread and clear the requests.
+     * @param resume
+     */
+    template <typename Resume>
+    void drain(Resume resume){
+        if (!any_pending.exchange(false, std::memory_order_acquire)){
+            return;
+        }
+        for (int word = 0; word < WAKEUP_WORDS; word++){
+            uint64_t bits = pending[word].exchange(0, std::memory_order_acquire);
+            while (bits != 0){
+                int bit = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                resume(word * WAKEUP_WORD_BITS + bit);
+            }
+        }
+    }
+};
+
+
+#endif //EX2_WAKEUPQUEUE_HPP
@@ -0,0 +1,74 @@
+/*
+ * Cancellation: a blocked thread is woken, runs its cleanup handlers most recent first with its
+ * last error set to UTHREAD_ECANCELED, and terminates without any error report. A thread
+ * canceled while READY acts on the request when it blocks itself instead of returning.
+ */
+
+#include <cstdio>
+#include <unistd.h>
+#include "uthreads.h"
+#include "check.hpp"
+
+#define HANDLERS 3
+
+static int order[HANDLERS];
+static int ran;
+static int errors_seen[HANDLERS];
+static volatile bool go;
+static volatile bool returned_from_block;
+
+void cleanup(void *arg){
+    errors_seen[ran] = uthread_last_error();
+    order[ran++] = (int)(long)arg;
+}
+
+void blocked(){
+    for (long i = 1; i <= HANDLERS; i++){
+        CHECK(uthread_cleanup_push(cleanup, (void*)i) == 0);
+    }
+    uthread_block(uthread_get_tid());
+    returned_from_block = true;
+}
+
+void canceled_while_ready(){
+    SPIN_UNTIL(go);
+    uthread_block(uthread_get_tid());
+    returned_from_block = true;
+    uthread_testcancel();
+}
+
+int main(){
+    // Error reports go to stderr: catch them in a file to check there are none.
+    char path[] = "/tmp/uthreads_cancel_XXXXXX";
+    int err = mkstemp(path);
+    CHECK(err >= 0);
+    unlink(path);
+    int saved_stderr = dup(STDERR_FILENO);
+    CHECK(dup2(err, STDERR_FILENO) == STDERR_FILENO);
+
+    CHECK(uthread_init(1000) == 0);
+    uthread_set_error_drain(0);
+    int tid = uthread_spawn(blocked);
+    CHECK(tid == 1);
+    SPIN_UNTIL(thread_state(tid) == UTHREAD_STATE_BLOCKED);
+    CHECK(uthread_cancel(tid) == 0);
+    SPIN_UNTIL(thread_state(tid) == -1);
+    CHECK(!returned_from_block);
+    CHECK(ran == HANDLERS);
+    for (int i = 0; i < HANDLERS; i++){
+        CHECK(order[i] == HANDLERS - i);
+        CHECK(errors_seen[i] == UTHREAD_ECANCELED);
+    }
+
+    tid = uthread_spawn(canceled_while_ready);
+    CHECK(tid == 1);
+    CHECK(uthread_cancel(tid) == 0);
+    go = true;
+    SPIN_UNTIL(thread_state(tid) == -1);
+    CHECK(!returned_from_block);
+
+    CHECK(uthread_flush_errors() == 0);
+    CHECK(lseek(err, 0, SEEK_END) == 0);
+    dup2(saved_stderr, STDERR_FILENO);
+    return 0;
+}
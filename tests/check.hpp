@@ -0,0 +1,45 @@
+#ifndef EX2_TESTS_CHECK_HPP
+#define EX2_TESTS_CHECK_HPP
+
+
+#include <cstdio>
+#include <cstdlib>
+#include "uthreads.h"
+
+
+/**
+ * Fail the test (exit status 1) with the location of the failed condition.
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)){ \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            std::exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+
+
+/**
+ * Spin until the condition holds (the timer preempts the caller meanwhile).
+ */
+#define SPIN_UNTIL(condition) while (!(condition)){}
+
+
+
+/**
+ * @param tid
+ * @return The state of the thread (one of UTHREAD_STATE_*), or -1 if it does not exist.
+ */
+inline int thread_state(int tid){
+    struct uthread_info info[MAX_THREAD_NUM];
+    int count = uthread_snapshot(info, MAX_THREAD_NUM);
+    for (int i = 0; i < count; i++){
+        if (info[i].tid == tid){
+            return info[i].state;
+        }
+    }
+    return -1;
+}
+
+
+#endif //EX2_TESTS_CHECK_HPP
@@ -0,0 +1,66 @@
+/*
+ * Cooperative mode: threads switch at safepoints, a quantum set after uthread_init_cooperative
+ * takes effect on the ticker, and a thread exits on its own stack.
+ */
+
+#include <ctime>
+#include "uthreads.h"
+#include "check.hpp"
+
+#define SLOW_QUANTUM_USECS 100000
+#define FAST_QUANTUM_USECS 1000
+#define RUN_MSECS 500
+
+static volatile long counter;
+static volatile bool exit_handler_ran;
+static volatile bool reached_after_exit;
+
+long now_msecs(){
+    struct timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void count(){
+    for (;;){
+        counter++;
+        uthread_maybe_yield();
+    }
+}
+
+void on_exit_handler(void*){
+    exit_handler_ran = true;
+}
+
+void exits(){
+    CHECK(uthread_cleanup_push(on_exit_handler, nullptr) == 0);
+    uthread_maybe_yield();
+    uthread_exit();
+    reached_after_exit = true;
+}
+
+int main(){
+    CHECK(uthread_init_cooperative(SLOW_QUANTUM_USECS) == 0);
+    CHECK(uthread_spawn(count) == 1);
+    // Let the ticker run on the slow quantum before changing it.
+    while (uthread_get_total_quantums() < 2){
+        uthread_maybe_yield();
+    }
+    CHECK(uthread_set_quantum_range(FAST_QUANTUM_USECS, FAST_QUANTUM_USECS) == 0);
+    long start = now_msecs();
+    while (now_msecs() - start < RUN_MSECS){
+        uthread_maybe_yield();
+    }
+    // With the slow quantum only a few quanta fit in the run.
+    CHECK(uthread_get_total_quantums() > RUN_MSECS / 10);
+    CHECK(uthread_get_quantums(1) > 1);
+    CHECK(counter > 0);
+    int tid = uthread_spawn(exits);
+    CHECK(tid == 2);
+    while (thread_state(tid) != -1){
+        uthread_maybe_yield();
+    }
+    CHECK(exit_handler_ran);
+    CHECK(!reached_after_exit);
+    return 0;
+}
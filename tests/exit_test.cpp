@@ -0,0 +1,60 @@
+/*
+ * Thread exit: uthread_exit, terminating oneself and returning from the entry function all run
+ * the thread's cleanup handlers (most recent first) and never return to the thread. Exited
+ * threads are reaped, so their ids (and stacks) are reused by far more spawns than
+ * MAX_THREAD_NUM.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define GENERATIONS (3 * MAX_THREAD_NUM)
+
+static int order[2];
+static int ran;
+static volatile bool reached_after_exit;
+static volatile int exited;
+
+void cleanup(void *arg){
+    order[ran++] = (int)(long)arg;
+}
+
+void count_exit(void*){
+    exited++;
+}
+
+void exits(){
+    CHECK(uthread_cleanup_push(cleanup, (void*)1) == 0);
+    CHECK(uthread_cleanup_push(cleanup, (void*)2) == 0);
+    uthread_exit();
+    reached_after_exit = true;
+}
+
+void terminates_itself(){
+    CHECK(uthread_cleanup_push(count_exit, nullptr) == 0);
+    uthread_terminate(uthread_get_tid());
+    reached_after_exit = true;
+}
+
+void returns(){
+    CHECK(uthread_cleanup_push(count_exit, nullptr) == 0);
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    int tid = uthread_spawn(exits);
+    CHECK(tid == 1);
+    SPIN_UNTIL(thread_state(tid) == -1);
+    CHECK(ran == 2 && order[0] == 2 && order[1] == 1);
+
+    for (int i = 0; i < GENERATIONS; i++){
+        int before = exited;
+        tid = uthread_spawn(i % 2 == 0 ? terminates_itself : returns);
+        // The previous generations are reaped, so the ids never run out.
+        CHECK(tid == 1);
+        SPIN_UNTIL(exited == before + 1);
+        SPIN_UNTIL(thread_state(tid) == -1);
+    }
+    CHECK(!reached_after_exit);
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * The FP state of a flagged thread survives a voluntary switch (a preempted thread gets its state
+ * back from the signal frame anyway), flagging it again while it is switched out keeps its saved
+ * state, and unflagged threads run with the default state.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+#include <xmmintrin.h>
+
+#define ROUND_TOWARD_ZERO 0x6000
+
+static volatile int phase;
+
+static volatile unsigned seen_flagged, seen_plain;
+
+void flagged(){
+    _mm_setcsr(_mm_getcsr() | ROUND_TOWARD_ZERO);
+    phase = 1;
+    uthread_block(uthread_get_tid());
+    seen_flagged = _mm_getcsr();
+    phase = 3;
+    uthread_exit();
+}
+
+void plain(){
+    SPIN_UNTIL(phase == 3);
+    seen_plain = _mm_getcsr();
+    phase = 4;
+    uthread_exit();
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    int a = uthread_spawn(flagged);
+    CHECK(uthread_set_fpu(a, 1) == 0);
+    CHECK(uthread_spawn(plain) != -1);
+    CHECK(uthread_set_fpu(MAX_THREAD_NUM - 1, 1) == -1);
+    SPIN_UNTIL(phase == 1 && thread_state(a) == UTHREAD_STATE_BLOCKED);
+    CHECK(uthread_set_fpu(a, 1) == 0);
+    CHECK(uthread_resume(a) == 0);
+    SPIN_UNTIL(phase == 4);
+    CHECK((seen_flagged & ROUND_TOWARD_ZERO) == ROUND_TOWARD_ZERO);
+    CHECK((seen_plain & ROUND_TOWARD_ZERO) == 0);
+    CHECK((_mm_getcsr() & ROUND_TOWARD_ZERO) == 0);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Gang scheduling: the ready members of a group run in consecutive quantums, and a group of three
+ * or more members still lets the threads outside it run in between its turns.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define MEMBERS 3
+#define GROUP 1
+#define QUANTUMS 400
+#define NOT_TRACED -1
+
+static volatile int trace[QUANTUMS];
+
+void note(){
+    int quantum = uthread_get_total_quantums();
+    if (quantum < QUANTUMS){
+        trace[quantum] = uthread_get_tid();
+    }
+}
+
+void spin(){
+    for (;;){
+        note();
+    }
+}
+
+bool is_member(int tid){
+    return tid >= 1 && tid <= MEMBERS;
+}
+
+int main(){
+    for (int quantum = 0; quantum < QUANTUMS; quantum++){
+        trace[quantum] = NOT_TRACED;
+    }
+    CHECK(uthread_init(1000) == 0);
+    for (int tid = 1; tid <= MEMBERS + 1; tid++){
+        CHECK(uthread_spawn(spin) == tid);
+    }
+    int outsider = MEMBERS + 1;
+    for (int tid = 1; tid <= MEMBERS; tid++){
+        CHECK(uthread_set_group(tid, GROUP) == 0);
+    }
+    while (uthread_get_total_quantums() < QUANTUMS){
+        note();
+    }
+    // Five threads share the quantums: the outsider and main get a share of their own.
+    CHECK(uthread_get_quantums(outsider) > QUANTUMS / 10);
+    CHECK(uthread_get_quantums(0) > QUANTUMS / 10);
+    // A gang turn starts with a member after another thread and runs every member once.
+    int turns = 0, whole_turns = 0;
+    for (int quantum = QUANTUMS / 4; quantum < QUANTUMS - MEMBERS; quantum++){
+        if (trace[quantum - 1] == NOT_TRACED || is_member(trace[quantum - 1]) || !is_member(trace[quantum])){
+            continue;
+        }
+        turns++;
+        bool whole = true;
+        for (int next = 1; next < MEMBERS; next++){
+            whole = whole && is_member(trace[quantum + next]) && trace[quantum + next] != trace[quantum];
+        }
+        whole = whole && trace[quantum + 1] != trace[quantum + 2];
+        whole_turns += whole;
+    }
+    CHECK(turns > 0);
+    CHECK(whole_turns * 10 >= turns * 8);
+    return 0;
+}
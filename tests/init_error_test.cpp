@@ -0,0 +1,37 @@
+/*
+ * Errors reported before a successful uthread_init (there is no tick to drain them yet) are still
+ * written to stderr when the process exits.
+ */
+
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "uthreads.h"
+#include "check.hpp"
+
+#define EXPECTED "thread library error: Non positive quantum_usecs."
+
+int main(){
+    int out[2];
+    CHECK(pipe(out) == 0);
+    pid_t child = fork();
+    CHECK(child >= 0);
+    if (child == 0){
+        dup2(out[1], STDERR_FILENO);
+        close(out[0]);
+        close(out[1]);
+        return uthread_init(0) == -1 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    close(out[1]);
+    char report[256] = {0};
+    size_t length = 0;
+    ssize_t got;
+    while (length < sizeof(report) - 1 && (got = read(out[0], report + length, sizeof(report) - 1 - length)) > 0){
+        length += got;
+    }
+    int status;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    CHECK(std::strstr(report, EXPECTED) != nullptr);
+    return 0;
+}
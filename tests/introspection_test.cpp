@@ -0,0 +1,85 @@
+/*
+ * Introspection: the published page describes the threads, every quantum (a switch included) is
+ * one seqlock update, resuming a thread publishes it only if it was blocked, and readers reject
+ * objects that are too short or no longer published.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "uthreads.h"
+#include "Introspection.hpp"
+#include "check.hpp"
+
+#define QUANTUMS 100
+#define RESUMES 1000
+
+void blocks(){
+    uthread_block(uthread_get_tid());
+}
+
+void spins(){
+    for (;;){}
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    CHECK(uthread_introspection_start() == 0);
+    CHECK(uthread_introspection_start() == -1);
+    int blocked = uthread_spawn(blocks);
+    int spinner = uthread_spawn(spins);
+    SPIN_UNTIL(thread_state(blocked) == UTHREAD_STATE_BLOCKED);
+
+    const IntrospectionPage *page = Introspection::attach(getpid());
+    CHECK(page != nullptr);
+    // Only the spinner and the main thread run now: one update per quantum.
+    unsigned long sequence = page->sequence.load();
+    int quantums = uthread_get_total_quantums();
+    SPIN_UNTIL(uthread_get_total_quantums() >= quantums + QUANTUMS);
+    unsigned long updates = (page->sequence.load() - sequence) / 2;
+    quantums = uthread_get_total_quantums() - quantums;
+    CHECK(updates >= (unsigned long)quantums - 2 && updates <= (unsigned long)quantums + 2);
+
+    static IntrospectionSnapshot snapshot;
+    while (!Introspection::read(page, snapshot)){}
+    CHECK(snapshot.running == 0);
+    CHECK(snapshot.total_quantums >= QUANTUMS);
+    CHECK(snapshot.threads[0].state == UTHREAD_STATE_RUNNING);
+    CHECK(snapshot.threads[blocked].state == UTHREAD_STATE_BLOCKED);
+    CHECK(snapshot.threads[blocked].wait_reason == UTHREAD_WAIT_BLOCK);
+    CHECK(snapshot.threads[spinner].state == UTHREAD_STATE_READY);
+    CHECK(snapshot.threads[spinner].quantums > 1);
+    CHECK(snapshot.threads[spinner + 1].state == NO_THREAD_STATE);
+
+    // Resuming threads that are not blocked changes nothing, so it is not published.
+    sequence = page->sequence.load();
+    quantums = uthread_get_total_quantums();
+    for (int i = 0; i < RESUMES; i++){
+        CHECK(uthread_resume(spinner) == 0);
+        CHECK(uthread_resume(0) == 0);
+    }
+    updates = (page->sequence.load() - sequence) / 2;
+    CHECK(updates <= (unsigned long)(uthread_get_total_quantums() - quantums) + 2);
+    sequence = page->sequence.load();
+    CHECK(uthread_resume(blocked) == 0);
+    CHECK(page->sequence.load() > sequence);
+    munmap((void*)page, sizeof(IntrospectionPage));
+
+    CHECK(uthread_introspection_stop() == 0);
+    CHECK(Introspection::attach(getpid()) == nullptr);
+
+    // A valid header in an object too short for a page (posing as the one of a process that does
+    // not exist): mapping it whole would fault on the first read past the header.
+    int fake_pid = 1 << 30;
+    char name[INTROSPECTION_NAME_SIZE];
+    std::snprintf(name, sizeof(name), INTROSPECTION_NAME_FORMAT, fake_pid);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    CHECK(fd >= 0);
+    uint32_t header[] = {INTROSPECTION_MAGIC, INTROSPECTION_VERSION, (uint32_t)fake_pid, MAX_THREAD_NUM};
+    CHECK(write(fd, header, sizeof(header)) == (ssize_t)sizeof(header));
+    close(fd);
+    const IntrospectionPage *short_page = Introspection::attach(fake_pid);
+    shm_unlink(name);
+    CHECK(short_page == nullptr);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * With the flusher running, a log fd that stops accepting writes (a full pipe nobody reads) stalls
+ * only the flusher: threads keep being scheduled and logging, and once the pipe is read every
+ * record comes out whole and in order.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "uthreads.h"
+#include "check.hpp"
+
+#define RECORDS 3000
+#define RECORD_SIZE 12
+#define PIPE_SIZE 4096
+#define QUANTUMS 50
+
+static volatile long counter;
+
+void count(){
+    for (;;){
+        counter++;
+    }
+}
+
+int main(){
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+    CHECK(uthread_init(1000) == 0);
+    uthread_log_set_fd(fds[1]);
+    CHECK(uthread_log_start_flusher() == 0);
+    CHECK(uthread_log_start_flusher() == -1);
+    CHECK(uthread_spawn(count) == 1);
+    char record[RECORD_SIZE + 1];
+    for (int i = 0; i < RECORDS; i++){
+        std::snprintf(record, sizeof(record), "record %04d\n", i);
+        CHECK(uthread_log(record, RECORD_SIZE) == 0);
+    }
+    CHECK(uthread_log_flush() == 0);
+    // The flusher is stuck on the full pipe, the scheduler is not.
+    int until = uthread_get_total_quantums() + QUANTUMS;
+    SPIN_UNTIL(uthread_get_total_quantums() >= until);
+    CHECK(counter > 0);
+    static char out[RECORDS * RECORD_SIZE];
+    size_t got = 0;
+    while (got < sizeof(out)){
+        ssize_t n = read(fds[0], out + got, sizeof(out) - got);
+        if (n < 0){
+            continue;
+        }
+        CHECK(n > 0);
+        got += n;
+        CHECK(uthread_log_flush() == 0);
+    }
+    for (int i = 0; i < RECORDS; i++){
+        std::snprintf(record, sizeof(record), "record %04d\n", i);
+        CHECK(std::memcmp(out + i * RECORD_SIZE, record, RECORD_SIZE) == 0);
+    }
+    return 0;
+}
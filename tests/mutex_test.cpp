@@ -0,0 +1,77 @@
+/*
+ * Timed mutex waits: a wait on a held mutex expires with UTHREAD_ETIMEDOUT (and is reported as a
+ * timed wait meanwhile), a non-positive timeout only tries once, and a wait long enough for the
+ * holder to unlock acquires the mutex.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define SHORT_TIMEOUT_USECS 5000
+#define LONG_TIMEOUT_USECS 10000000
+
+static volatile int result = 1;
+static volatile int error = UTHREAD_EOK;
+static volatile bool done;
+
+void times_out(){
+    result = uthread_mutex_timedlock(SHORT_TIMEOUT_USECS);
+    error = uthread_last_error();
+    done = true;
+}
+
+void tries_once(){
+    result = uthread_mutex_timedlock(0);
+    error = uthread_last_error();
+    done = true;
+}
+
+void acquires(){
+    result = uthread_mutex_timedlock(LONG_TIMEOUT_USECS);
+    error = uthread_last_error();
+    CHECK(uthread_mutex_unlock() == 0);
+    done = true;
+}
+
+/**
+ * @param tid A thread waiting for the mutex.
+ * @return The wait reason uthread_snapshot reports for it.
+ */
+int wait_reason(int tid){
+    struct uthread_info info[MAX_THREAD_NUM];
+    int count = uthread_snapshot(info, MAX_THREAD_NUM);
+    for (int i = 0; i < count; i++){
+        if (info[i].tid == tid){
+            CHECK(info[i].wait_target == 0);
+            return info[i].wait_reason;
+        }
+    }
+    return UTHREAD_WAIT_NONE;
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    CHECK(uthread_mutex_lock() == 0);
+
+    int tid = uthread_spawn(times_out);
+    SPIN_UNTIL(done || thread_state(tid) == UTHREAD_STATE_WAITING);
+    if (!done){
+        CHECK(wait_reason(tid) == UTHREAD_WAIT_MUTEX_TIMED);
+    }
+    SPIN_UNTIL(done);
+    CHECK(result == -1 && error == UTHREAD_ETIMEDOUT);
+
+    done = false;
+    uthread_spawn(tries_once);
+    SPIN_UNTIL(done);
+    CHECK(result == -1 && error == UTHREAD_ETIMEDOUT);
+
+    done = false;
+    tid = uthread_spawn(acquires);
+    SPIN_UNTIL(thread_state(tid) == UTHREAD_STATE_WAITING);
+    CHECK(uthread_mutex_unlock() == 0);
+    SPIN_UNTIL(done);
+    CHECK(result == 0 && error == UTHREAD_EOK);
+    CHECK(uthread_mutex_lock() == 0);
+    return 0;
+}
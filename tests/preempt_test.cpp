@@ -0,0 +1,32 @@
+/*
+ * Threads on private STACK_SIZE stacks are preempted many times (the timer signal frame and the
+ * switch path land on their stacks) and keep their state.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define THREADS 4
+#define QUANTUMS 300
+
+static volatile long counters[THREADS + 1];
+
+void count(){
+    int me = uthread_get_tid();
+    for (;;){
+        counters[me]++;
+    }
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    for (int i = 0; i < THREADS; i++){
+        CHECK(uthread_spawn(count) == i + 1);
+    }
+    SPIN_UNTIL(uthread_get_total_quantums() >= QUANTUMS);
+    for (int tid = 1; tid <= THREADS; tid++){
+        CHECK(uthread_get_quantums(tid) > 1);
+        CHECK(counters[tid] > 0);
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Published quantum counts: before uthread_init no thread exists, a spawned thread reads 0 until it
+ * runs and then never goes back, and a terminated thread's id reads -1 again.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define THREADS 8
+#define QUANTUMS 200
+
+static volatile bool ran[THREADS + 1];
+
+void run(){
+    ran[uthread_get_tid()] = true;
+    for (;;){}
+}
+
+int main(){
+    int all[MAX_THREAD_NUM];
+    CHECK(uthread_get_all_quantums(all, MAX_THREAD_NUM) == MAX_THREAD_NUM);
+    for (int tid = 0; tid < MAX_THREAD_NUM; tid++){
+        CHECK(all[tid] == -1);
+    }
+    CHECK(uthread_init(1000) == 0);
+    CHECK(uthread_get_quantums(0) == 1);
+    for (int i = 1; i <= THREADS; i++){
+        CHECK(uthread_spawn(run) == i);
+        int quantums = uthread_get_quantums(i);
+        CHECK(quantums == 0 || (quantums == 1 && ran[i]));
+    }
+    SPIN_UNTIL(uthread_get_total_quantums() >= QUANTUMS);
+    CHECK(uthread_get_all_quantums(all, MAX_THREAD_NUM) == MAX_THREAD_NUM);
+    for (int tid = 1; tid <= THREADS; tid++){
+        CHECK(ran[tid] && all[tid] >= 1);
+    }
+    for (int tid = THREADS + 1; tid < MAX_THREAD_NUM; tid++){
+        CHECK(all[tid] == -1);
+    }
+    CHECK(uthread_terminate(THREADS) == 0);
+    CHECK(uthread_get_all_quantums(all, MAX_THREAD_NUM) == MAX_THREAD_NUM);
+    CHECK(all[THREADS] == -1);
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Group quotas: a group limited to a fifth of every period (together with its child group) gets
+ * about that share of the CPU, period after period, while the other threads get the rest. The
+ * hierarchy rejects cycles, and invalid quotas are errors.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define PARENT 1
+#define CHILD 2
+#define GRANDCHILD 3
+#define QUOTA_USECS 20000
+#define PERIOD_USECS 100000
+#define PHASE_NS 500000000L
+#define MIN_SHARE_PERCENT 10
+#define MAX_SHARE_PERCENT 30
+
+void spin(){
+    for (;;){}
+}
+
+/**
+ * Read the CPU time of every thread (indexed by id, 0 for unused ids) in one snapshot.
+ * @param out
+ */
+void cpu_times(long out[MAX_THREAD_NUM]){
+    struct uthread_info info[MAX_THREAD_NUM];
+    int count = uthread_snapshot(info, MAX_THREAD_NUM);
+    for (int tid = 0; tid < MAX_THREAD_NUM; tid++){
+        out[tid] = 0;
+    }
+    for (int i = 0; i < count; i++){
+        out[info[i].tid] = info[i].cpu_time_ns;
+    }
+}
+
+/**
+ * Spin until the threads used another PHASE_NS of CPU time together.
+ * @param first_limited
+ * @param second_limited The threads of the limited groups.
+ * @return The share (in percent) of that time the limited threads got.
+ */
+long limited_share(int first_limited, int second_limited){
+    long before[MAX_THREAD_NUM], after[MAX_THREAD_NUM];
+    cpu_times(before);
+    long total = 0;
+    while (total < PHASE_NS){
+        cpu_times(after);
+        total = 0;
+        for (int tid = 0; tid < MAX_THREAD_NUM; tid++){
+            total += after[tid] - before[tid];
+        }
+    }
+    long limited = after[first_limited] - before[first_limited] + after[second_limited] - before[second_limited];
+    return limited * 100 / total;
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+
+    // The hierarchy: CHILD under PARENT, GRANDCHILD under CHILD; no group may become its own
+    // ancestor.
+    CHECK(uthread_group_set_parent(CHILD, PARENT) == 0);
+    CHECK(uthread_group_set_parent(GRANDCHILD, CHILD) == 0);
+    CHECK(uthread_group_set_parent(PARENT, GRANDCHILD) == -1);
+    CHECK(uthread_group_set_parent(PARENT, CHILD) == -1);
+    CHECK(uthread_group_set_parent(PARENT, PARENT) == -1);
+    CHECK(uthread_last_error() == UTHREAD_EINVAL);
+    CHECK(uthread_group_set_parent(0, PARENT) == -1);
+    CHECK(uthread_group_set_parent(PARENT, -1) == -1);
+    // Moving a subtree elsewhere is fine.
+    CHECK(uthread_group_set_parent(GRANDCHILD, PARENT) == 0);
+    CHECK(uthread_group_set_parent(GRANDCHILD, 0) == 0);
+
+    CHECK(uthread_group_set_quota(PARENT, QUOTA_USECS, 0) == -1);
+    CHECK(uthread_group_set_quota(PARENT, -1, PERIOD_USECS) == -1);
+    CHECK(uthread_group_set_quota(0, QUOTA_USECS, PERIOD_USECS) == -1);
+
+    // Four threads compete: unlimited, the two in the hierarchy would get half the CPU.
+    int in_parent = uthread_spawn(spin);
+    int in_child = uthread_spawn(spin);
+    int outsider = uthread_spawn(spin);
+    CHECK(outsider != -1);
+    CHECK(uthread_set_group(in_parent, PARENT) == 0);
+    CHECK(uthread_set_group(in_child, CHILD) == 0);
+    CHECK(uthread_group_set_quota(PARENT, QUOTA_USECS, PERIOD_USECS) == 0);
+
+    // Both phases span several periods: without the rollover the limited threads would get
+    // nothing after their first quota.
+    for (int phase = 0; phase < 2; phase++){
+        long share = limited_share(in_parent, in_child);
+        CHECK(share >= MIN_SHARE_PERCENT && share <= MAX_SHARE_PERCENT);
+    }
+
+    // Without the quota, they get their half again.
+    CHECK(uthread_group_set_quota(PARENT, 0, PERIOD_USECS) == 0);
+    CHECK(limited_share(in_parent, in_child) > MAX_SHARE_PERCENT);
+    return 0;
+}
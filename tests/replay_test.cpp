@@ -0,0 +1,121 @@
+/*
+ * A run recorded under the random policy, with one quantum-spanning stretch held by deferred
+ * preemption, is replayed in a fresh process under Round-Robin without the deferral: every
+ * quantum runs the thread it ran when recorded, and no decision diverges.
+ */
+
+#include <cstdlib>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "uthreads.h"
+#include "check.hpp"
+
+#define THREADS 3
+#define QUANTUMS 60
+#define HOLD_FROM 10
+#define HOLD 4
+#define NOT_TRACED -1
+
+static volatile int trace[QUANTUMS];
+static bool recording;
+static volatile bool held;
+
+void note(){
+    int quantum = uthread_get_total_quantums();
+    if (quantum < QUANTUMS){
+        trace[quantum] = uthread_get_tid();
+    }
+}
+
+void spin(){
+    for (;;){
+        note();
+        if (recording && !held && uthread_get_tid() == 1 && uthread_get_total_quantums() >= HOLD_FROM){
+            held = true;
+            int from = uthread_get_total_quantums();
+            uthread_defer_preemption();
+            while (uthread_get_total_quantums() < from + HOLD){
+                note();
+            }
+            uthread_allow_preemption();
+        }
+    }
+}
+
+/**
+ * Run the threads (recording or replaying the log at path) and write the trace to fd.
+ */
+int run(const char *path, int fd){
+    for (int quantum = 0; quantum < QUANTUMS; quantum++){
+        trace[quantum] = NOT_TRACED;
+    }
+    CHECK(uthread_init(1000) == 0);
+    if (recording){
+        CHECK(uthread_set_sched_policy(UTHREAD_SCHED_RANDOM, 7) == 0);
+    }
+    for (int i = 0; i < THREADS; i++){
+        CHECK(uthread_spawn(spin) == i + 1);
+    }
+    CHECK((recording ? uthread_record_start(path) : uthread_replay_start(path)) == 0);
+    while (uthread_get_total_quantums() < QUANTUMS){
+        note();
+    }
+    uthread_defer_preemption();
+    CHECK(uthread_schedule_log_stop() == 0);
+    int copy[QUANTUMS];
+    for (int quantum = 0; quantum < QUANTUMS; quantum++){
+        copy[quantum] = trace[quantum];
+    }
+    CHECK(write(fd, copy, sizeof(copy)) == (ssize_t)sizeof(copy));
+    return 0;
+}
+
+/**
+ * Fork a run and read its trace.
+ */
+void run_child(const char *path, int out[QUANTUMS]){
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0){
+        close(fds[0]);
+        std::exit(run(path, fds[1]));
+    }
+    close(fds[1]);
+    size_t got = 0;
+    ssize_t n;
+    while (got < QUANTUMS * sizeof(int) && (n = read(fds[0], (char*)out + got, QUANTUMS * sizeof(int) - got)) > 0){
+        got += n;
+    }
+    close(fds[0]);
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(got == QUANTUMS * sizeof(int));
+}
+
+int main(){
+    char path[] = "/tmp/uthreads_replay_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    int recorded[QUANTUMS], replayed[QUANTUMS];
+    recording = true;
+    run_child(path, recorded);
+    recording = false;
+    run_child(path, replayed);
+    unlink(path);
+    int compared = 0, repeats = 0;
+    for (int quantum = 2; quantum < QUANTUMS - 1; quantum++){
+        if (recorded[quantum] == NOT_TRACED || replayed[quantum] == NOT_TRACED){
+            continue;
+        }
+        CHECK(recorded[quantum] == replayed[quantum]);
+        compared++;
+        repeats += recorded[quantum] == recorded[quantum - 1];
+    }
+    CHECK(compared > QUANTUMS / 2);
+    CHECK(repeats >= HOLD - 1);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Restartable sections: a thread preempted inside a registered section continues at its abort
+ * handler, so a lock-free read-modify-write that commits with its last instruction never loses
+ * an update, although every thread is preempted inside it again and again.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define THREADS 3
+#define INCREMENTS 2000
+
+extern "C" {
+    volatile long counter;
+    volatile long aborts;
+    extern char increment_start[], increment_end[], increment_abort[];
+    void increment(volatile long *value);
+}
+
+// increment(value): load, add one, spin a while (so ticks land inside the section), then commit
+// with the last instruction of the section. The abort handler counts the restart and reruns it.
+asm(".text\n"
+    ".globl increment, increment_start, increment_end, increment_abort\n"
+    "increment:\n"
+    "increment_start:\n"
+    "    movq (%rdi), %rax\n"
+    "    incq %rax\n"
+    "    movq $100000, %rcx\n"
+    "1:  decq %rcx\n"
+    "    jnz 1b\n"
+    "    movq %rax, (%rdi)\n"
+    "increment_end:\n"
+    "    ret\n"
+    "increment_abort:\n"
+    "    incq aborts(%rip)\n"
+    "    jmp increment_start\n");
+
+static volatile bool finished[THREADS + 1];
+
+void run(){
+    for (int i = 0; i < INCREMENTS; i++){
+        increment(&counter);
+    }
+    finished[uthread_get_tid()] = true;
+    uthread_exit();
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    CHECK(uthread_register_restartable(increment_end, increment_start, increment_abort) == -1);
+    CHECK(uthread_register_restartable(increment_start, increment_end, nullptr) == -1);
+    CHECK(uthread_register_restartable(increment_start, increment_end, increment_abort) == 0);
+    for (int i = 0; i < THREADS; i++){
+        CHECK(uthread_spawn(run) != -1);
+    }
+    for (int tid = 1; tid <= THREADS; tid++){
+        SPIN_UNTIL(finished[tid]);
+    }
+    CHECK(aborts > 0);
+    CHECK(counter == THREADS * INCREMENTS);
+    return 0;
+}
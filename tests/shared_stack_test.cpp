@@ -0,0 +1,114 @@
+/*
+ * Threads on the shared stack keep their frames across preemptions: every switch saves the
+ * resident's frames to its buffer and restores the next thread's. Parked threads only keep their
+ * used portion resident, and a thread on the shared stack can end the process.
+ */
+
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "uthreads.h"
+#include "check.hpp"
+
+#define THREADS 4
+#define DEPTH 16
+#define FRAME_WORDS 64
+#define SHARED_STACK_SIZE (256 * 1024)
+
+static volatile int finished[THREADS + 1];
+
+static volatile bool parked[MAX_THREAD_NUM];
+
+/**
+ * Recurse with a frame filled with the thread's id, spin at the bottom so the thread is switched
+ * out with all its frames on the shared stack, and check every frame on the way back.
+ */
+static void nest(int me, int depth){
+    volatile long frame[FRAME_WORDS];
+    for (int i = 0; i < FRAME_WORDS; i++){
+        frame[i] = me * 1000 + depth;
+    }
+    if (depth > 0){
+        nest(me, depth - 1);
+    } else {
+        int start = uthread_get_quantums(me);
+        SPIN_UNTIL(uthread_get_quantums(me) >= start + 5);
+    }
+    for (int i = 0; i < FRAME_WORDS; i++){
+        CHECK(frame[i] == me * 1000 + depth);
+    }
+}
+
+void run(){
+    int me = uthread_get_tid();
+    nest(me, DEPTH);
+    finished[me] = 1;
+    uthread_exit();
+}
+
+void park(){
+    parked[uthread_get_tid()] = true;
+    uthread_block(uthread_get_tid());
+}
+
+void ends_process(){
+    uthread_terminate(0);
+}
+
+/**
+ * @return The resident set size of the process in KB.
+ */
+long rss_kb(){
+    FILE *status = std::fopen("/proc/self/status", "r");
+    CHECK(status != nullptr);
+    char line[256];
+    long kb = -1;
+    while (std::fgets(line, sizeof(line), status) != nullptr){
+        if (std::strncmp(line, "VmRSS:", 6) == 0){
+            kb = std::atol(line + 6);
+        }
+    }
+    std::fclose(status);
+    CHECK(kb > 0);
+    return kb;
+}
+
+int main(){
+    // Terminating the process from the shared stack: exit() runs on the stack while static
+    // destructors run.
+    pid_t child = fork();
+    CHECK(child >= 0);
+    if (child == 0){
+        uthread_init(1000);
+        uthread_enable_shared_stack(SHARED_STACK_SIZE);
+        uthread_spawn(ends_process);
+        for (;;){}
+    }
+    int status;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    CHECK(uthread_init(1000) == 0);
+    CHECK(uthread_enable_shared_stack(0) == -1);
+    CHECK(uthread_enable_shared_stack(SHARED_STACK_SIZE) == 0);
+    CHECK(uthread_enable_shared_stack(SHARED_STACK_SIZE) == -1);
+    for (int i = 0; i < THREADS; i++){
+        CHECK(uthread_spawn(run) != -1);
+    }
+    for (int tid = 1; tid <= THREADS; tid++){
+        SPIN_UNTIL(finished[tid]);
+    }
+
+    // Every parked thread was evicted with a small image: the save buffers hold that much, not a
+    // whole shared stack each.
+    long before = rss_kb();
+    for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+        CHECK(uthread_spawn(park) != -1);
+    }
+    for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+        SPIN_UNTIL(parked[tid] && thread_state(tid) == UTHREAD_STATE_BLOCKED);
+    }
+    long parked_kb = rss_kb() - before;
+    CHECK(parked_kb < (MAX_THREAD_NUM - 1) * (SHARED_STACK_SIZE / 1024) / 8);
+    return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * uthread_malloc: blocks of every size class are aligned and usable, freed blocks are recycled,
+ * and sizes that can't be allocated (including ones that overflow with the block header) fail
+ * with NULL instead of returning a short block.
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include "uthreads.h"
+#include "check.hpp"
+
+#define ALIGNMENT 16
+#define LARGEST_SMALL_BLOCK 2048
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    for (size_t size = 1; size <= 4 * LARGEST_SMALL_BLOCK; size *= 2){
+        auto block = (char*)uthread_malloc(size);
+        CHECK(block != nullptr);
+        CHECK((uintptr_t)block % ALIGNMENT == 0);
+        std::memset(block, 0x5a, size);
+        uthread_free(block);
+        // A small block goes back to its class's free list and is handed out next.
+        if (size <= LARGEST_SMALL_BLOCK){
+            CHECK(uthread_malloc(size) == block);
+            uthread_free(block);
+        }
+    }
+    uthread_free(nullptr);
+    size_t huge_sizes[] = {SIZE_MAX, SIZE_MAX - 1, SIZE_MAX - 8, SIZE_MAX / 2};
+    for (size_t size : huge_sizes){
+        errno = 0;
+        CHECK(uthread_malloc(size) == nullptr);
+        CHECK(errno == ENOMEM);
+    }
+    return 0;
+}
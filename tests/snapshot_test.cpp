@@ -0,0 +1,54 @@
+/*
+ * uthread_snapshot: one consistent pass describes every thread in increasing id order with its
+ * state, why and for whom it waits, its quantums and CPU time, and stops at n entries.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define QUANTUMS 50
+
+void blocks(){
+    uthread_block(uthread_get_tid());
+}
+
+void waits(){
+    uthread_mutex_lock();
+}
+
+void spins(){
+    for (;;){}
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    CHECK(uthread_mutex_lock() == 0);
+    int blocked = uthread_spawn(blocks);
+    int waiting = uthread_spawn(waits);
+    int ready = uthread_spawn(spins);
+    SPIN_UNTIL(thread_state(blocked) == UTHREAD_STATE_BLOCKED && thread_state(waiting) == UTHREAD_STATE_WAITING);
+    SPIN_UNTIL(uthread_get_total_quantums() >= QUANTUMS);
+
+    struct uthread_info info[MAX_THREAD_NUM];
+    int count = uthread_snapshot(info, MAX_THREAD_NUM);
+    CHECK(count == 4);
+    for (int i = 0; i < count; i++){
+        CHECK(info[i].tid == i);
+    }
+    CHECK(info[0].state == UTHREAD_STATE_RUNNING && info[0].wait_reason == UTHREAD_WAIT_NONE);
+    CHECK(info[blocked].state == UTHREAD_STATE_BLOCKED && info[blocked].wait_reason == UTHREAD_WAIT_BLOCK);
+    CHECK(info[blocked].wait_target == -1);
+    CHECK(info[waiting].state == UTHREAD_STATE_WAITING && info[waiting].wait_reason == UTHREAD_WAIT_MUTEX);
+    CHECK(info[waiting].wait_target == 0);
+    CHECK(info[ready].state == UTHREAD_STATE_READY && info[ready].wait_target == -1);
+    CHECK(info[ready].quantums > 1 && info[ready].quantums <= uthread_get_quantums(ready));
+    CHECK(info[0].cpu_time_ns > 0 && info[ready].cpu_time_ns > 0);
+
+    CHECK(uthread_snapshot(info, 2) == 2);
+    CHECK(info[1].tid == blocked);
+    CHECK(uthread_snapshot(info, 0) == 0);
+    CHECK(uthread_snapshot(info, -1) == -1);
+    CHECK(uthread_snapshot(nullptr, 1) == -1);
+    CHECK(uthread_last_error() == UTHREAD_EINVAL);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * A thread that overflows its stack faults on the guard page right below it, instead of silently
+ * writing into the next mapping (and faulting, if at all, much further down). The first stack
+ * handed out is the lowest of its region, which has a guard below it whether the region is made
+ * of huge pages or every stack is guarded.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+#include <csignal>
+#include <cstdint>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ALT_STACK_SIZE (64 * 1024)
+#define GUARD_MISSED 2
+
+static volatile uintptr_t stack_top;
+
+static volatile long sink;
+
+static void on_fault(int sig, siginfo_t *info, void *context){
+    uintptr_t fault = (uintptr_t)info->si_addr;
+    bool in_guard = fault < stack_top && stack_top - fault <= STACK_SIZE + (uintptr_t)sysconf(_SC_PAGESIZE);
+    _exit(in_guard ? EXIT_SUCCESS : GUARD_MISSED);
+}
+
+static void overflow(long depth){
+    volatile char frame[512];
+    frame[0] = (char)depth;
+    sink += frame[0];
+    overflow(depth + 1);
+}
+
+void run(){
+    volatile char top;
+    stack_top = (uintptr_t)&top;
+    overflow(0);
+}
+
+void idle(){
+    for (;;){}
+}
+
+int main(){
+    pid_t child = fork();
+    CHECK(child >= 0);
+    if (child == 0){
+        static char alt_stack[ALT_STACK_SIZE];
+        stack_t alt{};
+        alt.ss_sp = alt_stack;
+        alt.ss_size = ALT_STACK_SIZE;
+        sigaltstack(&alt, nullptr);
+        struct sigaction action{};
+        action.sa_sigaction = on_fault;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigaction(SIGSEGV, &action, nullptr);
+        uthread_init(1000);
+        uthread_spawn(run);
+        uthread_spawn(idle);
+        for (;;){}
+    }
+    int status;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    return 0;
+}
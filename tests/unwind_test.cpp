@@ -0,0 +1,91 @@
+/*
+ * Unwinding: a thread that exits, terminates itself or is canceled runs its cleanup handlers and
+ * then the destructors of the locals of every frame on its stack, innermost first.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define DEPTH 8
+#define EXIT 0
+#define TERMINATE 1
+#define CANCEL 2
+
+static volatile int destroyed;
+static volatile int destroyed_before_handler;
+static volatile int innermost_destroyed_first;
+static volatile bool reached_after_exit;
+
+/**
+ * A local that counts its destruction.
+ */
+struct Local {
+    int depth;
+
+    explicit Local(int depth): depth(depth) {}
+
+    ~Local(){
+        if (destroyed == 0){
+            innermost_destroyed_first = depth == 0;
+        }
+        destroyed++;
+    }
+};
+
+void on_exit_handler(void*){
+    destroyed_before_handler = destroyed;
+}
+
+/**
+ * Nest DEPTH frames with a local each, then leave the thread the given way at the bottom.
+ */
+void nest(int depth, int how){
+    Local local(depth);
+    if (depth > 0){
+        nest(depth - 1, how);
+    } else if (how == EXIT){
+        uthread_exit();
+    } else if (how == TERMINATE){
+        uthread_terminate(uthread_get_tid());
+    } else {
+        uthread_block(uthread_get_tid());
+    }
+    reached_after_exit = true;
+}
+
+void exits(){
+    CHECK(uthread_cleanup_push(on_exit_handler, nullptr) == 0);
+    nest(DEPTH - 1, EXIT);
+}
+
+void terminates_itself(){
+    CHECK(uthread_cleanup_push(on_exit_handler, nullptr) == 0);
+    nest(DEPTH - 1, TERMINATE);
+}
+
+void is_canceled(){
+    CHECK(uthread_cleanup_push(on_exit_handler, nullptr) == 0);
+    nest(DEPTH - 1, CANCEL);
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    void (*routines[])(void) = {exits, terminates_itself, is_canceled};
+    for (int how = EXIT; how <= CANCEL; how++){
+        destroyed = 0;
+        destroyed_before_handler = -1;
+        innermost_destroyed_first = 0;
+        int tid = uthread_spawn(routines[how]);
+        CHECK(tid != -1);
+        if (how == CANCEL){
+            SPIN_UNTIL(thread_state(tid) == UTHREAD_STATE_BLOCKED);
+            CHECK(uthread_cancel(tid) == 0);
+        }
+        SPIN_UNTIL(thread_state(tid) == -1);
+        CHECK(destroyed_before_handler == 0);
+        CHECK(destroyed == DEPTH);
+        CHECK(innermost_destroyed_first);
+    }
+    CHECK(!reached_after_exit);
+    return 0;
+}
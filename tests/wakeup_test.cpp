@@ -0,0 +1,57 @@
+/*
+ * uthread_resume_async from another kernel thread resumes a blocked thread at the next scheduling
+ * point and kicks the wakeup eventfd, which stays readable until the caller reads it.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+#include <csignal>
+#include <cstdint>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+static volatile int resumed;
+
+static volatile int sleeper_id;
+
+void sleeper(){
+    uthread_block(uthread_get_tid());
+    resumed = 1;
+    uthread_exit();
+}
+
+void* waker(void*){
+    uthread_resume_async(sleeper_id);
+    return nullptr;
+}
+
+static bool readable(int fd){
+    struct pollfd event{fd, POLLIN, 0};
+    return poll(&event, 1, 0) == 1;
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    int fd = uthread_wakeup_fd();
+    CHECK(fd >= 0);
+    CHECK(uthread_wakeup_fd() == fd);
+    CHECK(!readable(fd));
+    CHECK(uthread_resume_async(MAX_THREAD_NUM) == -1);
+    sleeper_id = uthread_spawn(sleeper);
+    SPIN_UNTIL(thread_state(sleeper_id) == UTHREAD_STATE_BLOCKED);
+    sigset_t timer_signal;
+    sigemptyset(&timer_signal);
+    sigaddset(&timer_signal, SIGVTALRM);
+    pthread_sigmask(SIG_BLOCK, &timer_signal, nullptr);
+    pthread_t thread;
+    CHECK(pthread_create(&thread, nullptr, waker, nullptr) == 0);
+    pthread_sigmask(SIG_UNBLOCK, &timer_signal, nullptr);
+    CHECK(pthread_join(thread, nullptr) == 0);
+    SPIN_UNTIL(resumed);
+    CHECK(readable(fd));
+    uint64_t count;
+    CHECK(read(fd, &count, sizeof(count)) == sizeof(count) && count == 1);
+    CHECK(!readable(fd));
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Terminated threads become zombies that the next spawn reaps: with every id in use spawning fails,
+ * and once threads are terminated (by another thread or by themselves) their ids are free again,
+ * round after round.
+ */
+
+#include "uthreads.h"
+#include "check.hpp"
+
+#define ROUNDS 5
+
+static volatile bool started[MAX_THREAD_NUM];
+
+void spins(){
+    started[uthread_get_tid()] = true;
+    for (;;){}
+}
+
+void exits(){
+    started[uthread_get_tid()] = true;
+    uthread_exit();
+}
+
+bool all_started(){
+    for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+        if (!started[tid]){
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(){
+    CHECK(uthread_init(1000) == 0);
+    for (int round = 0; round < ROUNDS; round++){
+        for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+            started[tid] = false;
+        }
+        // No thread runs (and exits) before every id is taken.
+        uthread_defer_preemption();
+        for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+            CHECK(uthread_spawn(round % 2 == 0 ? spins : exits) == tid);
+        }
+        uthread_allow_preemption();
+        if (round % 2 == 0){
+            CHECK(uthread_spawn(spins) == -1);
+            CHECK(uthread_last_error() == UTHREAD_EAGAIN);
+            SPIN_UNTIL(all_started());
+            for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+                CHECK(uthread_terminate(tid) == 0);
+            }
+        } else {
+            SPIN_UNTIL(all_started());
+            for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+                SPIN_UNTIL(thread_state(tid) == -1);
+            }
+        }
+        for (int tid = 1; tid < MAX_THREAD_NUM; tid++){
+            CHECK(thread_state(tid) == -1);
+        }
+    }
+    return 0;
+}
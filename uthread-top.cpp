@@ -0,0 +1,88 @@
+/*
+ * uthread-top: a top-like view of a process using the uthreads library, read from the
+ * shared-memory object the library publishes after uthread_introspection_start.
+ * Usage: uthread-top <pid> [interval_ms] [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "Introspection.hpp"
+
+
+#define DEFAULT_INTERVAL_MS 1000
+#define FOREVER 0
+#define USAGE "Usage: uthread-top <pid> [interval_ms] [iterations]\n"
+#define ERR_ATTACH "uthread-top: process %d publishes no uthreads introspection (or another version).\n"
+#define CLEAR_SCREEN "\033[H\033[2J"
+#define NSECS_PER_MSEC 1000000L
+
+
+static const char *state_name(int state){
+    switch (state){
+        case UTHREAD_STATE_RUNNING: return "RUNNING";
+        case UTHREAD_STATE_READY: return "READY";
+        case UTHREAD_STATE_BLOCKED: return "BLOCKED";
+        case UTHREAD_STATE_WAITING: return "WAITING";
+        default: return "?";
+    }
+}
+
+
+static const char *wait_name(int wait_reason){
+    switch (wait_reason){
+        case UTHREAD_WAIT_BLOCK: return "block";
+        case UTHREAD_WAIT_MUTEX: return "mutex";
+        case UTHREAD_WAIT_MUTEX_TIMED: return "mutex (timed)";
+        default: return "-";
+    }
+}
+
+
+/**
+ * Print one consistent copy of the page.
+ * @param pid
+ * @param snapshot
+ */
+static void render(int pid, const IntrospectionSnapshot& snapshot){
+    std::printf("uthreads of process %d: %ld quantums, running thread %d\n\n",
+                pid, snapshot.total_quantums, snapshot.running);
+    std::printf("%5s  %-8s  %10s  %12s  %s\n", "TID", "STATE", "QUANTUMS", "CPU (ms)", "WAIT");
+    for (const struct uthread_info& info : snapshot.threads){
+        if (info.state == NO_THREAD_STATE){
+            continue;
+        }
+        std::printf("%5d  %-8s  %10d  %12.3f  %s\n", info.tid, state_name(info.state), info.quantums,
+                    (double)info.cpu_time_ns / NSECS_PER_MSEC, wait_name(info.wait_reason));
+    }
+    std::fflush(stdout);
+}
+
+
+int main(int argc, char **argv){
+    if (argc < 2 || argc > 4){
+        std::fprintf(stderr, USAGE);
+        return EXIT_FAILURE;
+    }
+    int pid = std::atoi(argv[1]);
+    long interval_ms = argc > 2 ? std::atol(argv[2]) : DEFAULT_INTERVAL_MS;
+    long iterations = argc > 3 ? std::atol(argv[3]) : FOREVER;
+    const IntrospectionPage *page = Introspection::attach(pid);
+    if (page == nullptr){
+        std::fprintf(stderr, ERR_ATTACH, pid);
+        return EXIT_FAILURE;
+    }
+    struct timespec interval{interval_ms / 1000, (interval_ms % 1000) * NSECS_PER_MSEC};
+    static IntrospectionSnapshot snapshot;
+    for (long i = 0; iterations == FOREVER || i < iterations; i++){
+        if (i > 0){
+            nanosleep(&interval, nullptr);
+        }
+        while (!Introspection::read(page, snapshot)){}
+        if (iterations != 1){
+            std::printf(CLEAR_SCREEN);
+        }
+        render(pid, snapshot);
+    }
+    return EXIT_SUCCESS;
+}
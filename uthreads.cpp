@@ -3,12 +3,28 @@
 #include "uthreads.h"
 #include "Thread.hpp"
 #include <ctime>
-#include <iostream>
 #include <list>
 #include <sys/time.h>
 #include <algorithm>
 #include "ThreadsCollectionManager.hpp"
+#include "SharedStack.hpp"
+#include "FpuState.hpp"
+#include "ErrorRing.hpp"
+#include "WakeupQueue.hpp"
+#include "ScheduleLog.hpp"
+#include "RestartableSections.hpp"
+#include "SlabAllocator.hpp"
+#include "LogRing.hpp"
+#include "TimerHeap.hpp"
+#include "Introspection.hpp"
+#include "Probes.hpp"
 #include <functional>
+#include <cerrno>
+#include <atomic>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <sys/syscall.h>
 
 
 #define FAILURE -1
@@ -23,14 +39,52 @@
 #define MUTEX_LOCK_TWICE "You already have the mutex, you probably lost it somewhere."
 #define ID_NOT_FOUND "A thread with the given id does not exist. or it's illegal to block this thread. "
 #define MUTEX_UNLOCKED "Can't unblock mutex. "
+#define ERR_EVENTFD "Error creating the wakeup eventfd. "
+#define ERR_FPU_ID "A thread with the given id does not exist. "
+#define ERR_PIN "Invalid cpu, or pinning the worker failed. "
+#define ERR_GROUP "A thread with the given id does not exist, or the group is negative. "
+#define ERR_GROUP_PARENT "Invalid group or parent, or the parent is a descendant of the group. "
+#define ERR_QUOTA "Invalid group, quota or period. "
+#define ERR_CLOCK "Error reading the thread CPU clock."
+#define NSECS_PER_USEC 1000L
+#define NSECS_PER_SEC 1000000000L
+#define USECS_PER_SEC 1000000L
+#define ERR_LOG_START "Already recording or replaying, or the log file is not usable. "
+#define ERR_LOG_STOP "Not recording or replaying. "
+#define ERR_POLICY "Unknown scheduling policy. "
+#define ERR_QUANTUM_RANGE "Invalid quantum range. "
+#define DEFAULT_RANDOM_SEED 0x9E3779B97F4A7C15ULL
+#define ERR_TICKER "Error starting the tick thread."
+#define ERR_SECTION "Invalid restartable section, or too many sections. "
+#define ERR_LOG_WRITE "Error writing the log."
+#define ERR_FLUSHER "The log flusher is already running, or it can't be started. "
+#define ERR_ALL_QUANTUMS "Negative count or null output array. "
+#define ERR_SNAPSHOT "Negative count or null info array. "
+#define ERR_INTROSPECTION_START "Already publishing. "
+#define ERR_INTROSPECTION_OPEN "Error creating the introspection shared-memory object. "
+#define ERR_INTROSPECTION_STOP "Not publishing. "
+#define ERR_EXIT "A terminated thread was resumed. "
+#define ERR_THREW "A thread routine threw an exception. "
+#define LOG_FLUSH_THRESHOLD (LOG_RING_SIZE / 2)
+#define NOT_SWITCHED -1
+#define MUTEX_TIMEOUT "Timed out waiting for the mutex. "
+#define ERR_CANCEL "A thread with the given id does not exist, or it's illegal to cancel this thread. "
+#define ERR_CLEANUP_EMPTY "No cleanup handler to pop. "
+#define ERR_SHARED_STACK "Non positive shared stack size, or the shared stack is already enabled. "
 
 
 using std::string;
-using std::endl;
-using std::cerr;
 using std::function;
 
 
+/**
+ * Thrown to terminate the running thread once its cleanup handlers ran: unwinding it runs the
+ * destructors of the thread's frames, and the thread's trampoline catches it and retires the
+ * thread. Code that catches every exception on a uthread must rethrow it.
+ */
+struct ThreadExit {};
+
+
 /**
  * The mutex object.
  */
@@ -44,8 +98,28 @@ struct Mutex{
 /**
  * A signal handler for SIGVTALARN.
  * @param sig
+ * @param info
+ * @param context The interrupted context (ucontext_t).
+ */
+void time_sig_handler(int sig, siginfo_t *info, void *context);
+
+/**
+ * End of a quantum: charge the running thread and make a scheduling decision
+ * (runs in the SIGVTALRM handler, or at a safepoint in cooperative mode).
+ * @param interrupted The context interrupted by the signal, nullptr at a safepoint.
+ */
+void tick(ucontext_t *interrupted);
+
+/**
+ * Body of the helper kernel thread that advances the tick counter in cooperative mode.
+ * @return nullptr
+ */
+void* tick_thread(void*);
+
+/**
+ * The initialization shared by uthread_init and uthread_init_cooperative.
  */
-void time_sig_handler(int sig);
+void init_library();
 
 
 /**
@@ -65,9 +139,199 @@ void switch_threads( const function<void()>&handle_curr_thread);
  */
 void switch_threads_mid_quantum(const function<void()>& handle_curr_thread);
 
+/**
+ * Count a quantum of the running thread and publish the new count for uthread_get_quantums and,
+ * in one introspection update, along with the records of both threads of a switch.
+ * @param thread The running thread.
+ * @param switched_out The thread switched out for it, or NOT_SWITCHED.
+ */
+void count_quantum(Thread& thread, int switched_out);
+
+/**
+ * Describe a live thread as uthread_snapshot reports it.
+ * @param tid
+ * @param entry
+ */
+void describe_thread(int tid, struct uthread_info& entry);
+
+/**
+ * Publish the state of the thread (or that its id is unused) if introspection is on. Called with
+ * the timer signal masked. A negative id is ignored.
+ * @param tid
+ */
+void publish_thread(int tid);
+
+/**
+ * Write the record of a thread (or that its id is unused) inside an introspection update. A
+ * negative id is ignored.
+ * @param tid
+ */
+void write_thread_record(int tid);
+
+/**
+ * Stop publishing, if publishing (registered with atexit).
+ */
+void close_introspection();
+
+/**
+ * Block the timer signal for good (registered with atexit last, so it runs first): the static
+ * destructors that run after the atexit handlers free the stacks and control blocks a tick would
+ * switch to.
+ */
+void stop_time_signal();
+
+/**
+ * The code every spawned thread starts running (with the timer signal blocked, see init_env):
+ * calls the thread's routine and, when it returns or the thread exits, runs the cleanup handlers
+ * left and retires the thread.
+ */
+void thread_main();
+
+/**
+ * Terminate the running thread: run its cleanup handlers (most recently pushed first), then
+ * unwind its stack with ThreadExit up to thread_main. Called with the timer signal masked.
+ */
+void exit_current_thread();
+
+/**
+ * Run the running thread's cleanup handlers, most recently pushed first. Called with the timer
+ * signal masked.
+ */
+void run_cleanup_handlers();
+
+/**
+ * Retire a thread: remove it from the scheduler, disarm its timer and release the mutex if it
+ * holds it. Its control block and stack are reclaimed in a batch at the next spawn, off the
+ * switch path and never while the thread may still be on its stack.
+ * @param tid
+ */
+void delete_thread(int tid);
+
+/**
+ * Jump to the running thread's context, copying its frames onto the shared stack first if needed.
+ */
+void jump_to_current_thread();
+
+/**
+ * Runs on the restorer stack: evict the resident thread from the shared stack, load the running
+ * thread's image and jump to it.
+ */
+void restore_shared_stack();
+
+/**
+ * Record a library error for the running thread in the error ring.
+ * @param code One of the UTHREAD_E* codes.
+ * @param message
+ */
+void library_error(int code, const char *message);
+
+/**
+ * Write the pending error reports to stderr (registered with atexit when the library is loaded,
+ * so reports of calls that fail before a successful init are written too).
+ */
+void drain_errors();
+
+/**
+ * Resume every thread that was posted with uthread_resume_async.
+ */
+void drain_wakeups();
+
+/**
+ * Resume a thread. Only if it actually left BLOCKED, fire the resume probe and publish it.
+ * Called with the timer signal masked.
+ * @param tid
+ * @return 0 upon success (including a thread that was not blocked) and -1 on failure.
+ */
+int wake_thread(int tid);
+
+/**
+ * @return The CPU time consumed by the library's kernel thread, in nanoseconds.
+ */
+long cpu_now_ns();
+
+/**
+ * Move the thread of the next replayed decision to the front of the ready queue.
+ */
+void force_recorded_thread();
+
+/**
+ * @return The next number of the seeded xorshift64* generator.
+ */
+uint64_t next_random();
+
+/**
+ * Draw the length of the next quantum when quantums are randomized.
+ */
+void randomize_quantum();
+
+/**
+ * Body of the helper kernel thread that writes the log buffer out (uthread_log_start_flusher).
+ * @return nullptr
+ */
+void* log_flusher_main(void*);
+
+/**
+ * Write the pending log records with one writev, unless another flush is in progress.
+ * @return false if the write failed.
+ */
+bool write_log();
+
+/**
+ * Wake the log flusher thread (once until it runs).
+ */
+void kick_log_flusher();
+
+/**
+ * Write the buffered log records (registered with atexit).
+ */
+void drain_log();
+
+/**
+ * Acquire the mutex, optionally giving up after a timeout.
+ * @param timed
+ * @param timeout_ns CPU time to wait when timed.
+ * @return 0 upon success and -1 on failure or timeout.
+ */
+int lock_mutex(bool timed, long timeout_ns);
+
+/**
+ * Wake a thread whose timed wait expired.
+ * @param id
+ */
+void expire_wait(int id);
+
+/**
+ * If cancellation of the running thread was requested, run its cleanup handlers and terminate
+ * it. Called at cancellation points with the timer signal masked.
+ */
+void act_on_cancel();
+
+/**
+ * Pop the most recently pushed cleanup handler of the running thread, which must have one.
+ * Called with the timer signal masked.
+ * @return The handler.
+ */
+CleanupHandler pop_cleanup_handler();
 
 /**
- * Initialize the timer struct with usecs (for setitimer).
+ * Restore the FP state of the given thread and jump to its context.
+ * @param thread
+ */
+void resume_thread(Thread& thread);
+
+/**
+ * @return The stack pointer of the caller (inlined so it reads the caller's frame).
+ */
+inline __attribute__((always_inline)) address_t current_stack_pointer(){
+    address_t sp;
+    asm volatile("mov %%rsp, %0" : "=r" (sp));
+    return sp;
+}
+
+
+/**
+ * Initialize the timer struct with usecs (for setitimer) and publish the
+ * quantum to the ticker of cooperative mode.
  * @param usecs
  */
 void init_timer(int usecs);
@@ -82,7 +346,7 @@ void mask_time_signal(int how);
 
 // --------- Static variables ---------------
 
-static struct sigaction time_handler = {time_sig_handler};
+static struct sigaction time_handler;
 
 static size_t total_quantums;
 
@@ -94,6 +358,66 @@ static sigset_t sigvtalarm;
 
 static Mutex mutex;
 
+static SharedStack sharedStack;
+
+static FpuState fpuState;
+
+static ErrorRing errorRing;
+
+static const int drain_errors_registered = atexit(drain_errors);
+
+static volatile sig_atomic_t drain_errors_on_tick = 1;
+
+static WakeupQueue wakeupQueue;
+
+static ScheduleLog scheduleLog;
+
+static int sched_policy = UTHREAD_SCHED_RR;
+
+static uint64_t random_state = DEFAULT_RANDOM_SEED;
+
+static int min_quantum_usecs;
+
+static int max_quantum_usecs;
+
+static bool cooperative;
+
+static RestartableSections restartableSections;
+
+static volatile sig_atomic_t deferral_depth;
+
+static volatile sig_atomic_t preemption_pending;
+
+static SlabAllocator slabAllocator;
+
+static LogRing logRing;
+
+static std::atomic<int> log_fd(STDOUT_FILENO);
+
+static bool log_flusher_started;
+
+static pthread_t log_flusher;
+
+static sem_t log_flusher_wakeup;
+
+static std::atomic<bool> log_flusher_kicked;
+
+static std::atomic<bool> log_flusher_stop;
+
+static std::atomic<bool> log_flushing;
+
+static std::atomic<bool> log_write_failed;
+
+static TimerHeap timerHeap(MAX_THREAD_NUM);
+
+static Introspection introspection;
+
+static std::atomic<size_t> cooperative_ticks;
+
+static std::atomic<int> cooperative_quantum_usecs;
+
+static size_t seen_ticks;
+
 
 // --------- Libraries public functions ---------------
 
@@ -108,22 +432,69 @@ static Mutex mutex;
 */
 int uthread_init(int quantum_usecs){
     if (quantum_usecs <= 0){
-        cerr << LIB_ERROR_MSG << ERR_INIT << endl;
+        library_error(UTHREAD_EINVAL, ERR_INIT);
         return FAILURE;
     }
     init_timer(quantum_usecs);
+    time_handler.sa_sigaction = time_sig_handler;
+    time_handler.sa_flags = SA_SIGINFO;
     bool sys_calls_err = (sigaction(SIGVTALRM, &time_handler ,nullptr) < 0 ||
                      sigemptyset(&sigvtalarm) < 0 ||     sigaddset(&sigvtalarm, SIGVTALRM) < 0);
     if (sys_calls_err) {
-        cerr << SYS_ERROR_MSG << ERR_SIG << endl;
-        exit(EXIT_FAILURE);
+        fatal_error(SYS_ERROR_MSG, ERR_SIG);
     }
-    total_quantums++;
+    init_library();
     set_timer();
     return SUCCESS;
 }
 
 
+/**
+ * Description: This function initializes the thread library in cooperative
+ * mode, as an alternative to uthread_init. No timer signal is used at all,
+ * so system calls are never interrupted with EINTR and no signal handler
+ * runs. A helper kernel thread advances a tick counter every quantum_usecs
+ * micro-seconds (wall clock), and threads are preempted only at safepoints:
+ * calls to uthread_maybe_yield, which switch threads if a tick passed since
+ * the last safepoint. It is an error to call this function with
+ * non-positive quantum_usecs.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_init_cooperative(int quantum_usecs){
+    if (quantum_usecs <= 0){
+        library_error(UTHREAD_EINVAL, ERR_INIT);
+        return FAILURE;
+    }
+    init_timer(quantum_usecs);
+    cooperative = true;
+    if (sigemptyset(&sigvtalarm) < 0 || sigaddset(&sigvtalarm, SIGVTALRM) < 0){
+        fatal_error(SYS_ERROR_MSG, ERR_SIG);
+    }
+    init_library();
+    pthread_t ticker;
+    if (pthread_create(&ticker, nullptr, tick_thread, nullptr) != 0 || pthread_detach(ticker) != 0){
+        fatal_error(SYS_ERROR_MSG, ERR_TICKER);
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function is a safepoint for cooperative mode: if a
+ * quantum passed since the last safepoint, a scheduling decision is made
+ * exactly as the timer signal would. When not in cooperative mode it does
+ * nothing. It costs one load and compare when no quantum passed.
+*/
+void uthread_maybe_yield(){
+    size_t ticks = cooperative_ticks.load(std::memory_order_relaxed);
+    if (ticks == seen_ticks){
+        return;
+    }
+    seen_ticks = ticks;
+    tick(nullptr);
+}
+
+
 /**
  * Description: This function creates a new thread, whose entry point is the
  * function f with the signature void f(void). The thread is added to the end
@@ -136,78 +507,72 @@ int uthread_init(int quantum_usecs){
 */
 int uthread_spawn(void (*f)(void)){
     int id;
+    mask_time_signal(SIG_BLOCK);
     try {
-        id = threadsCollectionManager.create_thread(f);
+        id = threadsCollectionManager.create_thread(f, thread_main);
     } catch (const std::bad_alloc& e) {
-        cerr << SYS_ERROR_MSG << BAD_ALLOC << endl;
-        std::exit(EXIT_FAILURE);
+        fatal_error(SYS_ERROR_MSG, BAD_ALLOC);
     }
     if (id == FAILURE){
-        cerr << LIB_ERROR_MSG << MAX_THREADS << endl;
+        library_error(UTHREAD_EAGAIN, MAX_THREADS);
+    } else {
+        UTHREADS_PROBE1(spawn, id);
+        publish_thread(id);
     }
+    mask_time_signal(SIG_UNBLOCK);
     return id;
 }
 
 
 /**
- * Description: This function terminates the thread with ID tid and deletes
- * it from all relevant control structures. All the resources allocated by
- * the library for this thread should be released. If no thread with ID tid
- * exists it is considered an error. Terminating the main thread
- * (tid == 0) will result in the termination of the entire process using
- * exit(0) [after releasing the assigned library memory].
- * Return value: The function returns 0 if the thread was successfully
- * terminated and -1 otherwise. If a thread terminates itself or the main
- * thread is terminated, the function does not return.
+ * Description: This function switches the library to shared-stack mode.
+ * Every thread spawned after this call runs on one shared stack of
+ * stack_size bytes instead of a private one. When such a thread is switched
+ * out and another shared-stack thread runs, the used portion of the shared
+ * stack is copied to a save buffer of the thread, and copied back before it
+ * runs again. Save buffers (stack_size bytes each) are allocated when the
+ * threads are spawned, so switching never allocates. It is an error to call this function with
+ * non-positive stack_size or more than once.
+ * Return value: On success, return 0. On failure, return -1.
 */
-int uthread_terminate(int tid){
+int uthread_enable_shared_stack(int stack_size){
     mask_time_signal(SIG_BLOCK);
-    if (tid == 0){
-        std::exit(EXIT_SUCCESS);
-    }
-    if (!threadsCollectionManager.contains(tid)){
-        cerr << LIB_ERROR_MSG << ID_NOT_FOUND << endl;
-        sigprocmask(SIG_UNBLOCK, &sigvtalarm, nullptr);
+    if (stack_size <= 0 || sharedStack.enabled()){
+        library_error(UTHREAD_EINVAL, ERR_SHARED_STACK);
+        mask_time_signal(SIG_UNBLOCK);
         return FAILURE;
     }
-    function<void()> delete_thread = [tid] () {
-        threadsCollectionManager.terminate(tid);
-        if (mutex.locking_thread == tid){
-            mutex.locking_thread = -1;
-            mutex.locked = false;
-            threadsCollectionManager.advance_mutex_line();
-        }
-    };
-    if (tid == threadsCollectionManager.get_curr_id()){
-        switch_threads_mid_quantum(delete_thread);
+    try {
+        sharedStack.enable(stack_size);
+    } catch (const std::bad_alloc& e) {
+        fatal_error(SYS_ERROR_MSG, BAD_ALLOC);
     }
-    delete_thread();
+    threadsCollectionManager.use_shared_stack(sharedStack.top(), sharedStack.get_size());
     mask_time_signal(SIG_UNBLOCK);
     return SUCCESS;
 }
 
 
-
 /**
- * Description: This function blocks the thread with ID tid. The thread may
- * be resumed later using uthread_resume. If no thread with ID tid exists it
- * is considered as an error. In addition, it is an error to try blocking the
- * main thread (tid == 0). If a thread blocks itself, a scheduling decision
- * should be made. Blocking a thread in BLOCKED state has no
- * effect and is not considered an error.
+ * Description: This function flags the thread with ID tid as using (or not
+ * using) floating point / vector state. The FP/SSE/AVX state of flagged
+ * threads is saved and restored on every switch, other threads skip it and
+ * only get the default MXCSR and x87 control words. The main thread is
+ * flagged by default, spawned threads are not. If no thread with ID tid
+ * exists it is considered an error.
  * Return value: On success, return 0. On failure, return -1.
 */
-int uthread_block(int tid){
+int uthread_set_fpu(int tid, int enabled){
     mask_time_signal(SIG_BLOCK);
-    if (tid == 0 || !threadsCollectionManager.contains(tid)){
-        cerr << LIB_ERROR_MSG << ID_NOT_FOUND << endl;
+    if (!threadsCollectionManager.contains(tid)){
+        library_error(UTHREAD_ESRCH, ERR_FPU_ID);
         mask_time_signal(SIG_UNBLOCK);
         return FAILURE;
     }
-    if (threadsCollectionManager.get_curr_id() == tid){
-        switch_threads_mid_quantum([tid](){threadsCollectionManager.block(tid); });
-    } else {
-        threadsCollectionManager.block(tid);
+    try {
+        fpuState.set_enabled(threadsCollectionManager.get_thread(tid), enabled != 0);
+    } catch (const std::bad_alloc& e) {
+        fatal_error(SYS_ERROR_MSG, BAD_ALLOC);
     }
     mask_time_signal(SIG_UNBLOCK);
     return SUCCESS;
@@ -215,100 +580,731 @@ int uthread_block(int tid){
 
 
 /**
- * Description: This function resumes a blocked thread with ID tid and moves
- * it to the READY state if it's not synced. Resuming a thread in a RUNNING or READY state
- * has no effect and is not considered as an error. If no thread with
- * ID tid exists it is considered an error.
+ * Description: This function pins the worker (the kernel thread running the
+ * uthreads) to the given cpu, so cache-hot threads keep running on one core.
+ * The thread control blocks move to the NUMA node of that cpu, and stacks
+ * allocated from then on are bound to (and first touched on) that node.
  * Return value: On success, return 0. On failure, return -1.
 */
-int uthread_resume(int tid){
-    mask_time_signal(SIG_BLOCK);
-    int success = threadsCollectionManager.resume(tid);
-    if (success == FAILURE) {
-        cerr << LIB_ERROR_MSG << ID_NOT_FOUND << endl;
+int uthread_pin_worker(int cpu){
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (cpu < 0 || cpu >= CPU_SETSIZE){
+        library_error(UTHREAD_EINVAL, ERR_PIN);
+        return FAILURE;
     }
-    mask_time_signal(SIG_UNBLOCK);
-    return success;
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0){
+        library_error(UTHREAD_EINVAL, ERR_PIN);
+        return FAILURE;
+    }
+    unsigned int curr_cpu, node;
+    if (syscall(SYS_getcpu, &curr_cpu, &node, nullptr) == 0){
+        mask_time_signal(SIG_BLOCK);
+        threadsCollectionManager.set_node((int)node);
+        mask_time_signal(SIG_UNBLOCK);
+    }
+    return SUCCESS;
 }
 
 
 /**
- * Description: This function tries to acquire a mutex.
- * If the mutex is unlocked, it locks it and returns.
- * If the mutex is already locked by different thread, the thread moves to BLOCK state.
- * In the future when this thread will be back to RUNNING state,
- * it will try again to acquire the mutex.
- * If the mutex is already locked by this thread, it is considered an error.
+ * Description: This function makes the thread with ID tid a member of the
+ * thread group group (a positive number), or removes it from its group if
+ * group is 0. Whenever a member of a group is scheduled after a thread
+ * outside the group, the other READY members of the group are moved to the
+ * front of the READY list, so tightly coupled threads run in consecutive
+ * quantums instead of being interleaved with unrelated threads. Each member
+ * runs once per such turn, then the other threads get theirs. If no thread
+ * with ID tid exists, or group is negative, it is considered an error.
  * Return value: On success, return 0. On failure, return -1.
 */
-int uthread_mutex_lock(){
+int uthread_set_group(int tid, int group){
     mask_time_signal(SIG_BLOCK);
-    if (mutex.locking_thread == threadsCollectionManager.get_curr_id()) {
-        cerr << LIB_ERROR_MSG << MUTEX_LOCK_TWICE << endl;
+    if (!threadsCollectionManager.contains(tid) || group < 0){
+        library_error(UTHREAD_EINVAL, ERR_GROUP);
         mask_time_signal(SIG_UNBLOCK);
         return FAILURE;
     }
-    while (mutex.locked){
-        int id = threadsCollectionManager.get_curr_id();
-        switch_threads_mid_quantum([id](){
-            threadsCollectionManager.wait_for_mutex(id);});
-    }
-    mutex.locked = true;
-    mutex.locking_thread = threadsCollectionManager.get_curr_id();
+    threadsCollectionManager.set_group(tid, group);
     mask_time_signal(SIG_UNBLOCK);
     return SUCCESS;
 }
 
 
-
 /**
- * Description: This function releases a mutex.
- * If there are blocked threads waiting for this mutex,
- * one of them (no matter which one) moves to READY state.
- * If the mutex is already unlocked, it is considered an error.
+ * Description: This function makes parent the parent of the thread group
+ * group in the group hierarchy (0 makes it a root group). Threads of a group
+ * are also limited by the CPU quotas of all its ancestors. It is an error if
+ * group is not positive, parent is negative, or the change creates a cycle.
  * Return value: On success, return 0. On failure, return -1.
 */
-int uthread_mutex_unlock(){
+int uthread_group_set_parent(int group, int parent){
     mask_time_signal(SIG_BLOCK);
-    if (!mutex.locked || mutex.locking_thread != threadsCollectionManager.get_curr_id()){
-        cerr << LIB_ERROR_MSG << MUTEX_UNLOCKED << endl;
+    GroupQuotas& groupQuotas = threadsCollectionManager.get_group_quotas();
+    if (group <= 0 || parent < 0 || !groupQuotas.can_set_parent(group, parent)){
+        library_error(UTHREAD_EINVAL, ERR_GROUP_PARENT);
         mask_time_signal(SIG_UNBLOCK);
         return FAILURE;
     }
-    mutex.locked = false;
-    mutex.locking_thread = -1;
-    threadsCollectionManager.advance_mutex_line();
+    groupQuotas.set_parent(group, parent);
     mask_time_signal(SIG_UNBLOCK);
     return SUCCESS;
 }
 
 
 /**
- * Description: This function returns the thread ID of the calling thread.
- * Return value: The ID of the calling thread.
+ * Description: This function limits the threads of the thread group group
+ * (and of its descendant groups) to quota_usecs of CPU time in every
+ * period_usecs of CPU time (e.g. 20000 out of 100000). A group that used up
+ * its quota is throttled: its READY threads are skipped by the scheduler
+ * until the next period, unless no other thread can run. A quota of 0
+ * removes the limit. It is an error if group or period_usecs is not
+ * positive, or quota_usecs is negative.
+ * Return value: On success, return 0. On failure, return -1.
 */
-int uthread_get_tid(){
-    return threadsCollectionManager.get_curr_id();
+int uthread_group_set_quota(int group, int quota_usecs, int period_usecs){
+    mask_time_signal(SIG_BLOCK);
+    if (group <= 0 || quota_usecs < 0 || period_usecs <= 0){
+        library_error(UTHREAD_EINVAL, ERR_QUOTA);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    long now_ns = cpu_now_ns();
+    threadsCollectionManager.charge_running_thread(now_ns);
+    threadsCollectionManager.get_group_quotas().set_quota(group, quota_usecs * NSECS_PER_USEC,
+                                                          period_usecs * NSECS_PER_USEC, now_ns);
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
 }
 
 
 /**
- * Description: This function returns the total number of quantums since
- * the library was initialized, including the current quantum.
- * Right after the call to uthread_init, the value should be 1.
- * Each time a new quantum starts, regardless of the reason, this number
- * should be increased by 1.
- * Return value: The total number of quantums.
+ * Description: This function starts recording every scheduling decision
+ * (the quantum index and the ID of the thread switched in) to a compact
+ * binary log at path, so the same interleaving can be forced later with
+ * uthread_replay_start. It is an error to start while recording or
+ * replaying, or if the file cannot be created.
+ * Return value: On success, return 0. On failure, return -1.
 */
-int uthread_get_total_quantums(){
-    return total_quantums;
+int uthread_record_start(const char *path){
+    mask_time_signal(SIG_BLOCK);
+    if (scheduleLog.get_mode() != ScheduleLog::OFF || !scheduleLog.start_record(path, total_quantums)){
+        library_error(UTHREAD_EINVAL, ERR_LOG_START);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
 }
 
 
 /**
- * Description: This function returns the number of quantums the thread with
- * ID tid was in RUNNING state. On the first time a thread runs, the function
- * should return 1. Every additional quantum that the thread starts should
+ * Description: This function starts replaying a log written by
+ * uthread_record_start: the running thread is not preempted before the
+ * quantum recorded for the next switch, and on every switch the thread
+ * recorded for that decision is scheduled next if it is READY. Decisions
+ * whose thread is not READY fall back to the normal policy, and switches
+ * that happen at another quantum than recorded (e.g. a thread blocks
+ * earlier) are followed anyway; both are counted as divergences. It
+ * is an error to start while recording or replaying, or if the file is not
+ * a valid log.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_replay_start(const char *path){
+    mask_time_signal(SIG_BLOCK);
+    bool started;
+    try {
+        started = scheduleLog.get_mode() == ScheduleLog::OFF && scheduleLog.start_replay(path, total_quantums);
+    } catch (const std::bad_alloc& e) {
+        fatal_error(SYS_ERROR_MSG, BAD_ALLOC);
+    }
+    if (!started){
+        library_error(UTHREAD_EINVAL, ERR_LOG_START);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function stops recording (writing the rest of the
+ * log) or replaying. It is an error to call it while neither is active.
+ * Return value: When replaying, the number of divergences. When recording,
+ * 0. On failure, return -1.
+*/
+int uthread_schedule_log_stop(){
+    mask_time_signal(SIG_BLOCK);
+    if (scheduleLog.get_mode() == ScheduleLog::OFF){
+        library_error(UTHREAD_EINVAL, ERR_LOG_STOP);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    int ret = (int)scheduleLog.stop();
+    mask_time_signal(SIG_UNBLOCK);
+    return ret;
+}
+
+
+/**
+ * Description: This function sets the scheduling policy. UTHREAD_SCHED_RR
+ * (the default) runs the READY threads in Round-Robin order.
+ * UTHREAD_SCHED_RANDOM picks the next thread from the READY threads
+ * pseudo-randomly; the sequence is determined by seed, so stress runs that
+ * shake out lock convoys and latency outliers can be reproduced. It is an
+ * error to pass an unknown policy.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_sched_policy(int policy, unsigned int seed){
+    if (policy != UTHREAD_SCHED_RR && policy != UTHREAD_SCHED_RANDOM){
+        library_error(UTHREAD_EINVAL, ERR_POLICY);
+        return FAILURE;
+    }
+    mask_time_signal(SIG_BLOCK);
+    sched_policy = policy;
+    random_state = seed != 0 ? seed : DEFAULT_RANDOM_SEED;
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function makes the length of every quantum a
+ * pseudo-random number of micro-seconds in [min_usecs, max_usecs] (drawn
+ * from the generator seeded by uthread_set_sched_policy) instead of the
+ * fixed quantum_usecs given to uthread_init. Passing min_usecs == max_usecs
+ * returns to a fixed quantum. In cooperative mode the range applies to
+ * the ticker's wall-clock quanta. It is an error if min_usecs is not
+ * positive or max_usecs < min_usecs.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_quantum_range(int min_usecs, int max_usecs){
+    if (min_usecs <= 0 || max_usecs < min_usecs){
+        library_error(UTHREAD_EINVAL, ERR_QUANTUM_RANGE);
+        return FAILURE;
+    }
+    mask_time_signal(SIG_BLOCK);
+    min_quantum_usecs = min_usecs;
+    max_quantum_usecs = max_usecs;
+    init_timer(min_usecs);
+    randomize_quantum();
+    set_timer();
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function registers a restartable critical section: the
+ * code in [start, end). If the timer preempts a thread while its program
+ * counter is inside the section, the thread continues at abort when it runs
+ * again, instead of after the interrupted instruction. A section that reads
+ * per-worker data and publishes its update with its last instruction (the
+ * one right before end) can therefore run without locks or signal masking:
+ * the abort code simply retries it. Sections are usually delimited with
+ * local labels in inline assembly. It is an error if start >= end, abort is
+ * NULL, or MAX_RESTARTABLE_SECTIONS sections are already registered.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_register_restartable(void *start, void *end, void *abort){
+    mask_time_signal(SIG_BLOCK);
+    if (start >= end || abort == nullptr ||
+        !restartableSections.add((address_t)start, (address_t)end, (address_t)abort)){
+        library_error(UTHREAD_EINVAL, ERR_SECTION);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function marks the start of a region of the calling
+ * thread in which it must not be preempted, e.g. a call into malloc,
+ * iostream or other non-reentrant code. A timer tick that falls inside the
+ * region does not switch threads; the switch is made when the region ends
+ * (uthread_allow_preemption). Regions nest. Unlike masking the timer signal
+ * this costs no system call. Blocking calls made inside the region still
+ * switch threads.
+*/
+void uthread_defer_preemption(){
+    deferral_depth = deferral_depth + 1;
+}
+
+
+/**
+ * Description: This function ends a region started with
+ * uthread_defer_preemption. When the outermost region ends and a switch was
+ * deferred meanwhile, a scheduling decision is made right away. Calling it
+ * outside a region has no effect.
+*/
+void uthread_allow_preemption(){
+    if (deferral_depth == 0){
+        return;
+    }
+    deferral_depth = deferral_depth - 1;
+    if (deferral_depth != 0 || !preemption_pending){
+        return;
+    }
+    mask_time_signal(SIG_BLOCK);
+    preemption_pending = 0;
+    if (threadsCollectionManager.should_preempt()){
+        int curr_id = threadsCollectionManager.get_curr_id();
+        switch_threads_mid_quantum([curr_id]() {threadsCollectionManager.set_as_ready(curr_id);});
+    }
+    mask_time_signal(SIG_UNBLOCK);
+}
+
+
+/**
+ * Description: This function registers the code in [start, end) (e.g. the
+ * text of a non-reentrant library function) as non-preemptible: a timer tick
+ * that interrupts a thread inside it does not switch threads, and the thread
+ * is preempted on the next tick instead. It is an error if start >= end, or
+ * 32 sections and ranges are already registered.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_register_nonpreemptible(void *start, void *end){
+    mask_time_signal(SIG_BLOCK);
+    if (start >= end || !restartableSections.add((address_t)start, (address_t)end, NO_ABORT)){
+        library_error(UTHREAD_EINVAL, ERR_SECTION);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function allocates size bytes from the worker-local slab
+ * allocator. Small blocks (up to 2048 bytes) come from per-size-class free
+ * lists, so allocation-heavy threads get thread-cache speed. The call defers
+ * preemption internally, so it is safe without masking signals and never
+ * leaves the allocator half updated when the timer fires.
+ * Return value: A 16-byte aligned block, or NULL if out of memory.
+*/
+void* uthread_malloc(size_t size){
+    uthread_defer_preemption();
+    void *block = slabAllocator.allocate(size);
+    uthread_allow_preemption();
+    return block;
+}
+
+
+/**
+ * Description: This function releases a block returned by uthread_malloc.
+ * Passing NULL has no effect. Like uthread_malloc it is preemption-safe.
+*/
+void uthread_free(void *ptr){
+    uthread_defer_preemption();
+    slabAllocator.release(ptr);
+    uthread_allow_preemption();
+}
+
+
+/**
+ * Description: This function appends a log record (len bytes, usually a
+ * line ending with a newline) to the worker's log buffer. It never blocks
+ * and never makes a system call: the record is copied into a ring buffer
+ * with preemption deferred, so records are never torn by a thread switch.
+ * The buffer is written out by uthread_log_flush, by the flusher thread
+ * (uthread_log_start_flusher) and at exit. If the buffer is full the record
+ * is dropped.
+ * Return value: On success, return 0. If the record was dropped, return -1.
+*/
+int uthread_log(const char *message, size_t len){
+    uthread_defer_preemption();
+    bool appended = logRing.append(message, len);
+    bool kick_flusher = log_flusher_started && logRing.used() >= LOG_FLUSH_THRESHOLD;
+    uthread_allow_preemption();
+    if (kick_flusher){
+        kick_log_flusher();
+    }
+    return appended ? SUCCESS : FAILURE;
+}
+
+
+/**
+ * Description: This function writes the buffered log records to the log fd
+ * (stdout unless set with uthread_log_set_fd) with one writev. Without a
+ * flusher the write is made by the calling thread, and since all threads
+ * share one kernel thread, the whole scheduler waits for it. With a flusher
+ * running (uthread_log_start_flusher) the flusher is woken to write the
+ * buffer and the call returns at once.
+ * Return value: On success, return 0. On failure (including a failed write
+ * of the flusher since the last call), return -1.
+*/
+int uthread_log_flush(){
+    bool failed;
+    if (log_flusher_started){
+        kick_log_flusher();
+        failed = log_write_failed.exchange(false, std::memory_order_relaxed);
+    } else {
+        failed = !write_log();
+    }
+    if (failed){
+        library_error(UTHREAD_EIO, ERR_LOG_WRITE);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function starts a helper kernel thread that writes the
+ * log buffer out whenever it is more than half full or uthread_log_flush
+ * is called. The writes block only the helper, so neither the threads that
+ * log nor the scheduler ever wait for them. The helper blocks every signal.
+ * It is an error to start it twice, or if the helper cannot be started.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_log_start_flusher(){
+    if (log_flusher_started || sem_init(&log_flusher_wakeup, 0, 0) < 0){
+        library_error(UTHREAD_EINVAL, ERR_FLUSHER);
+        return FAILURE;
+    }
+    // The flusher inherits a mask of every signal, so the timer signal is never delivered to it.
+    sigset_t all, prev;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &prev);
+    bool started = pthread_create(&log_flusher, nullptr, log_flusher_main, nullptr) == 0;
+    pthread_sigmask(SIG_SETMASK, &prev, nullptr);
+    if (!started){
+        sem_destroy(&log_flusher_wakeup);
+        library_error(UTHREAD_EINVAL, ERR_FLUSHER);
+        return FAILURE;
+    }
+    log_flusher_started = true;
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function sets the file descriptor the log buffer is
+ * written to (stdout by default).
+*/
+void uthread_log_set_fd(int fd){
+    log_fd.store(fd, std::memory_order_relaxed);
+}
+
+
+/**
+ * Description: This function requests cancellation of the thread with ID
+ * tid. The thread is woken from any blocking call (a mutex wait, a timed
+ * wait or being blocked) and acts on the request at its next cancellation
+ * point: uthread_mutex_lock, uthread_mutex_timedlock, uthread_block of
+ * itself, or uthread_testcancel. There, on its own stack, its last error is
+ * set to UTHREAD_ECANCELED, its cleanup handlers run (most recently pushed
+ * first), its stack is unwound (see uthread_exit) and it terminates,
+ * releasing the mutex if it holds it. A thread that cancels itself does so
+ * right away. If no thread with ID tid exists,
+ * or tid is 0, it is considered an error.
+ * Return value: On success, return 0. On failure, return -1. If a thread
+ * cancels itself, the function does not return.
+*/
+int uthread_cancel(int tid){
+    mask_time_signal(SIG_BLOCK);
+    if (tid == 0 || !threadsCollectionManager.contains(tid)){
+        library_error(UTHREAD_ESRCH, ERR_CANCEL);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    threadsCollectionManager.get_thread(tid).cancel_requested = true;
+    if (tid == threadsCollectionManager.get_curr_id()){
+        act_on_cancel();
+    }
+    timerHeap.cancel(tid);
+    threadsCollectionManager.stop_waiting_for_mutex(tid);
+    threadsCollectionManager.resume(tid);
+    publish_thread(tid);
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function registers a cleanup handler for the calling
+ * thread: routine(arg) runs if the thread is canceled or terminates itself
+ * (including by returning from its entry function). Handlers run in the
+ * reverse order of their registration.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_cleanup_push(void (*routine)(void *), void *arg){
+    mask_time_signal(SIG_BLOCK);
+    try {
+        threadsCollectionManager.get_current_thread().cleanup_handlers.push_back({routine, arg});
+    } catch (const std::bad_alloc& e) {
+        fatal_error(SYS_ERROR_MSG, BAD_ALLOC);
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function removes the most recently pushed cleanup
+ * handler of the calling thread, and runs it if execute is non-zero. It is
+ * an error to call it when no handler is registered.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_cleanup_pop(int execute){
+    mask_time_signal(SIG_BLOCK);
+    if (threadsCollectionManager.get_current_thread().cleanup_handlers.empty()){
+        library_error(UTHREAD_EINVAL, ERR_CLEANUP_EMPTY);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    CleanupHandler handler = pop_cleanup_handler();
+    mask_time_signal(SIG_UNBLOCK);
+    if (execute){
+        handler.routine(handler.arg);
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function is a cancellation point: if cancellation of
+ * the calling thread was requested, it runs the thread's cleanup handlers
+ * and terminates it (see uthread_cancel). Otherwise it returns immediately.
+*/
+void uthread_testcancel(){
+    if (!threadsCollectionManager.get_current_thread().cancel_requested){
+        return;
+    }
+    mask_time_signal(SIG_BLOCK);
+    act_on_cancel();
+}
+
+
+/**
+ * Description: This function terminates the thread with ID tid and deletes
+ * it from all relevant control structures. All the resources allocated by
+ * the library for this thread should be released. If no thread with ID tid
+ * exists it is considered an error. Terminating the main thread
+ * (tid == 0) will result in the termination of the entire process using
+ * exit(0) [after releasing the assigned library memory].
+ * Return value: The function returns 0 if the thread was successfully
+ * terminated and -1 otherwise. If a thread terminates itself or the main
+ * thread is terminated, the function does not return. A thread that
+ * terminates itself runs its cleanup handlers and is unwound first (see
+ * uthread_exit).
+*/
+int uthread_terminate(int tid){
+    mask_time_signal(SIG_BLOCK);
+    if (tid == 0){
+        std::exit(EXIT_SUCCESS);
+    }
+    if (!threadsCollectionManager.contains(tid)){
+        library_error(UTHREAD_ESRCH, ID_NOT_FOUND);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    if (tid == threadsCollectionManager.get_curr_id()){
+        exit_current_thread();
+    }
+    delete_thread(tid);
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function terminates the calling thread, like
+ * uthread_terminate with its own ID: the thread's cleanup handlers run
+ * (most recently pushed first), then its stack is unwound, so the
+ * destructors of its C++ objects run, and it is then released. Called by
+ * the main thread, it exits the process. A thread whose entry function
+ * returns exits the same way (its frames are already gone). The unwinding
+ * is a C++ exception: code on a thread that catches every exception
+ * (catch (...)) must rethrow it.
+ * Return value: The function does not return.
+*/
+void uthread_exit(){
+    uthread_terminate(uthread_get_tid());
+}
+
+
+
+/**
+ * Description: This function blocks the thread with ID tid. The thread may
+ * be resumed later using uthread_resume. If no thread with ID tid exists it
+ * is considered as an error. In addition, it is an error to try blocking the
+ * main thread (tid == 0). If a thread blocks itself, a scheduling decision
+ * should be made. Blocking a thread in BLOCKED state has no
+ * effect and is not considered an error.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_block(int tid){
+    mask_time_signal(SIG_BLOCK);
+    if (tid == 0 || !threadsCollectionManager.contains(tid)){
+        library_error(UTHREAD_ESRCH, ID_NOT_FOUND);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    if (threadsCollectionManager.get_curr_id() == tid){
+        act_on_cancel();
+        switch_threads_mid_quantum([tid](){
+            threadsCollectionManager.block(tid);
+            UTHREADS_PROBE1(block, tid);
+        });
+        act_on_cancel();
+    } else if (!threadsCollectionManager.get_thread(tid).cancel_requested){
+        // A canceled thread is not blocked: it must reach its next cancellation point.
+        threadsCollectionManager.block(tid);
+        UTHREADS_PROBE1(block, tid);
+        publish_thread(tid);
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function resumes a blocked thread with ID tid and moves
+ * it to the READY state if it's not synced. Resuming a thread in a RUNNING or READY state
+ * has no effect and is not considered as an error. If no thread with
+ * ID tid exists it is considered an error.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_resume(int tid){
+    mask_time_signal(SIG_BLOCK);
+    int success = wake_thread(tid);
+    if (success == FAILURE) {
+        library_error(UTHREAD_ESRCH, ID_NOT_FOUND);
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return success;
+}
+
+
+/**
+ * Description: This function posts a resume request for the thread with ID
+ * tid. Unlike uthread_resume it may be called from any kernel thread (e.g.
+ * a callback thread of another library) and from signal handlers: it only
+ * sets a flag with one atomic operation and kicks the eventfd returned by
+ * uthread_wakeup_fd. The request is carried out like uthread_resume on the
+ * next scheduling point (thread switch or timer tick). Requests for threads
+ * that do not exist by then are ignored. Other kernel threads of the process
+ * should block SIGVTALRM, so the timer signal is always delivered to the
+ * library's thread.
+ * Return value: On success, return 0. If tid is out of range, return -1.
+*/
+int uthread_resume_async(int tid){
+    if (tid < 0 || tid >= MAX_THREAD_NUM){
+        return FAILURE;
+    }
+    wakeupQueue.post(tid);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function returns an eventfd that becomes readable when
+ * uthread_resume_async is called, so a thread that waits in poll/epoll for
+ * external events can notice the wakeup. The eventfd is created on the
+ * first call; until then posts do not write to it. It is only a hook for the
+ * caller's event loop: the library never reads it, so the caller must read
+ * it (8 bytes) when it becomes readable, or it stays readable. If it can't
+ * be created, it is considered an error.
+ * Return value: On success, return the eventfd. On failure, return -1.
+*/
+int uthread_wakeup_fd(){
+    mask_time_signal(SIG_BLOCK);
+    if (!wakeupQueue.init()){
+        library_error(UTHREAD_EIO, ERR_EVENTFD);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return wakeupQueue.get_fd();
+}
+
+
+/**
+ * Description: This function tries to acquire a mutex.
+ * If the mutex is unlocked, it locks it and returns.
+ * If the mutex is already locked by different thread, the thread moves to BLOCK state.
+ * In the future when this thread will be back to RUNNING state,
+ * it will try again to acquire the mutex.
+ * If the mutex is already locked by this thread, it is considered an error.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_lock(){
+    return lock_mutex(false, 0);
+}
+
+
+/**
+ * Description: This function tries to acquire the mutex like
+ * uthread_mutex_lock, but gives up if it is not acquired within
+ * timeout_usecs micro-seconds of CPU time of the kernel thread that runs
+ * the threads (CLOCK_THREAD_CPUTIME_ID, so time spent in other kernel
+ * threads of the process does not count). Deadlines are checked on every
+ * quantum, so the wait may last up to one quantum longer. A non-positive
+ * timeout only tries once. If the mutex is already locked by this thread,
+ * it is considered an error.
+ * Return value: On success, return 0. On failure or timeout, return -1
+ * (uthread_last_error tells UTHREAD_ETIMEDOUT apart).
+*/
+int uthread_mutex_timedlock(int timeout_usecs){
+    return lock_mutex(true, timeout_usecs * NSECS_PER_USEC);
+}
+
+
+
+/**
+ * Description: This function releases a mutex.
+ * If there are blocked threads waiting for this mutex,
+ * one of them (no matter which one) moves to READY state.
+ * If the mutex is already unlocked, it is considered an error.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_unlock(){
+    mask_time_signal(SIG_BLOCK);
+    if (!mutex.locked || mutex.locking_thread != threadsCollectionManager.get_curr_id()){
+        library_error(UTHREAD_EPERM, MUTEX_UNLOCKED);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    mutex.locked = false;
+    mutex.locking_thread = -1;
+    publish_thread(threadsCollectionManager.advance_mutex_line());
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function returns the thread ID of the calling thread.
+ * Return value: The ID of the calling thread.
+*/
+int uthread_get_tid(){
+    return threadsCollectionManager.get_curr_id();
+}
+
+
+/**
+ * Description: This function returns the total number of quantums since
+ * the library was initialized, including the current quantum.
+ * Right after the call to uthread_init, the value should be 1.
+ * Each time a new quantum starts, regardless of the reason, this number
+ * should be increased by 1.
+ * Return value: The total number of quantums.
+*/
+int uthread_get_total_quantums(){
+    return total_quantums;
+}
+
+
+/**
+ * Description: This function returns the number of quantums the thread with
+ * ID tid was in RUNNING state. On the first time a thread runs, the function
+ * should return 1. Every additional quantum that the thread starts should
  * increase this value by 1 (so if the thread with ID tid is in RUNNING state
  * when this function is called, include also the current quantum). If no
  * thread with ID tid exists it is considered an error.
@@ -316,14 +1312,155 @@ int uthread_get_total_quantums(){
  * 			     On failure, return -1.
 */
 int uthread_get_quantums(int tid){
+    int quantums = tid >= 0 && tid < MAX_THREAD_NUM
+                   ? threadsCollectionManager.get_published_quantums(tid) : FAILURE;
+    if (quantums == FAILURE){
+        library_error(UTHREAD_ESRCH, ID_NOT_FOUND);
+    }
+    return quantums;
+}
+
+
+/**
+ * Description: This function copies the number of quantums of every thread
+ * ID below n (and below MAX_THREAD_NUM) to out in one pass: out[tid] is the
+ * number of quantums of the thread with ID tid, or -1 if no such thread
+ * exists. Like uthread_get_quantums, it only reads counters the library
+ * publishes atomically, without masking the timer signal. It is an error
+ * to call it with a negative n or a null out.
+ * Return value: On success, return the number of entries written.
+ * On failure, return -1.
+*/
+int uthread_get_all_quantums(int *out, int n){
+    if (n < 0 || out == nullptr){
+        library_error(UTHREAD_EINVAL, ERR_ALL_QUANTUMS);
+        return FAILURE;
+    }
+    n = std::min(n, MAX_THREAD_NUM);
+    for (int tid = 0; tid < n; tid++){
+        out[tid] = threadsCollectionManager.get_published_quantums(tid);
+    }
+    return n;
+}
+
+/**
+ * Description: This function describes up to n threads, in increasing ID
+ * order, in one pass with the timer signal masked, so the entries are
+ * consistent with each other: for each thread its ID, state, number of
+ * quantums, CPU time and, unless it is running or ready, why it waits and
+ * for which thread (the holder of the mutex it waits for, or -1). It does
+ * not allocate memory. It is an error to call it with a negative n or a
+ * null info.
+ * Return value: On success, return the number of entries written. On
+ * failure, return -1.
+*/
+int uthread_snapshot(struct uthread_info *info, int n){
+    if (n < 0 || info == nullptr){
+        library_error(UTHREAD_EINVAL, ERR_SNAPSHOT);
+        return FAILURE;
+    }
     mask_time_signal(SIG_BLOCK);
-    if (!threadsCollectionManager.contains(tid)){
-        cerr << LIB_ERROR_MSG << ID_NOT_FOUND << endl;
+    threadsCollectionManager.charge_running_thread(cpu_now_ns());
+    int count = 0;
+    for (int tid = 0; tid < MAX_THREAD_NUM && count < n; tid++){
+        if (!threadsCollectionManager.contains(tid)){
+            continue;
+        }
+        describe_thread(tid, info[count++]);
+    }
+    mask_time_signal(SIG_UNBLOCK);
+    return count;
+}
+
+
+/**
+ * Description: This function starts publishing the state of the library to
+ * a POSIX shared-memory object named /uthreads.<pid>, for tools in other
+ * processes (uthread-top <pid> renders it). Each thread's state, quantums
+ * and CPU time, the running thread and the total number of quantums are
+ * published as they change, under a sequence lock, at the cost of a few
+ * stores per context switch. The object is removed when publishing stops
+ * or the process exits. It is an error to call this function while
+ * publishing, or if the object can't be created (UTHREAD_EIO).
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_introspection_start(){
+    mask_time_signal(SIG_BLOCK);
+    if (introspection.active()){
+        library_error(UTHREAD_EINVAL, ERR_INTROSPECTION_START);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    if (!introspection.open()){
+        library_error(UTHREAD_EIO, ERR_INTROSPECTION_OPEN);
+        mask_time_signal(SIG_UNBLOCK);
         return FAILURE;
     }
-    int quantums = threadsCollectionManager.get_thread(tid).quantums;
+    for (int tid = 0; tid < MAX_THREAD_NUM; tid++){
+        if (threadsCollectionManager.contains(tid)){
+            publish_thread(tid);
+        }
+    }
+    Thread& curr_thread = threadsCollectionManager.get_current_thread();
+    introspection.begin();
+    introspection.publish_quantum(curr_thread.id, (int)curr_thread.quantums, (long)total_quantums);
+    introspection.end();
     mask_time_signal(SIG_UNBLOCK);
-    return quantums;
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function stops publishing and removes the
+ * shared-memory object. It is an error to call it when not publishing.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_introspection_stop(){
+    mask_time_signal(SIG_BLOCK);
+    if (!introspection.active()){
+        library_error(UTHREAD_EINVAL, ERR_INTROSPECTION_STOP);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    introspection.close();
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+/**
+ * Description: This function returns the error code (one of UTHREAD_E*) of
+ * the last library call of the calling thread that failed, or UTHREAD_EOK
+ * if none of its calls failed yet.
+ * Return value: The error code.
+*/
+int uthread_last_error(){
+    return threadsCollectionManager.get_current_thread().last_error;
+}
+
+
+/**
+ * Description: This function writes the pending library error reports to
+ * stderr. Failing calls only record their report in a preallocated ring,
+ * the reports are written when this function is called, on the next timer
+ * tick (unless disabled with uthread_set_error_drain) and at exit.
+ * Return value: The number of reports that were lost because the ring was full.
+*/
+int uthread_flush_errors(){
+    mask_time_signal(SIG_BLOCK);
+    errorRing.drain(STDERR_FILENO);
+    int dropped = (int)errorRing.get_dropped();
+    mask_time_signal(SIG_UNBLOCK);
+    return dropped;
+}
+
+
+/**
+ * Description: This function enables (or disables) writing the pending
+ * library error reports to stderr on the timer tick. It is enabled by default.
+*/
+void uthread_set_error_drain(int enabled){
+    drain_errors_on_tick = enabled != 0;
 }
 
 // --------- helper functions ---------------
@@ -335,50 +1472,449 @@ void init_timer(int usecs){
     time_val.tv_usec = usecs % 1000000;
     timer.it_value = time_val;
     timer.it_interval = time_val;
+    cooperative_quantum_usecs.store(usecs, std::memory_order_relaxed);
+}
+
+
+void init_library(){
+    fpuState.init();
+    fpuState.set_enabled(threadsCollectionManager.get_thread(0), true);
+    atexit(drain_log);
+    atexit(close_introspection);
+    atexit(stop_time_signal);
+    threadsCollectionManager.charge_running_thread(cpu_now_ns());
+    threadsCollectionManager.publish_quantums(0);
+    total_quantums++;
+}
+
+
+void* tick_thread(void*){
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+    while (true){
+        // Read every cycle, so a new quantum (or the next one of a quantum range) takes effect.
+        long usecs = cooperative_quantum_usecs.load(std::memory_order_relaxed);
+        struct timespec quantum{usecs / USECS_PER_SEC, (usecs % USECS_PER_SEC) * NSECS_PER_USEC};
+        while (nanosleep(&quantum, nullptr) < 0){}
+        cooperative_ticks.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+
+void time_sig_handler(int sig, siginfo_t *info, void *context){
+    tick((ucontext_t*)context);
 }
 
 
-void time_sig_handler(int sig){
-    if (!threadsCollectionManager.is_someone_waiting()){
+void tick(ucontext_t *interrupted){
+    if (drain_errors_on_tick && errorRing.pending()){
+        errorRing.drain(STDERR_FILENO);
+    }
+    drain_wakeups();
+    long now_ns = cpu_now_ns();
+    threadsCollectionManager.charge_running_thread(now_ns);
+    timerHeap.expire(now_ns, expire_wait);
+    if (max_quantum_usecs > min_quantum_usecs){
+        randomize_quantum();
+        set_timer();
+    }
+    bool replay_holds = scheduleLog.get_mode() == ScheduleLog::REPLAY && !scheduleLog.due(total_quantums + 1);
+    if (!threadsCollectionManager.should_preempt() || replay_holds){
+        total_quantums++;
+        count_quantum(threadsCollectionManager.get_current_thread(), NOT_SWITCHED);
+        return;
+    }
+    if (deferral_depth > 0 || (interrupted != nullptr && restartableSections.defers(interrupted))){
+        preemption_pending = deferral_depth > 0;
         total_quantums++;
-        threadsCollectionManager.get_current_thread().quantums++;
+        count_quantum(threadsCollectionManager.get_current_thread(), NOT_SWITCHED);
         return;
     }
+    if (interrupted != nullptr){
+        restartableSections.rewind(interrupted);
+    }
     int curr_id = threadsCollectionManager.get_curr_id();
     switch_threads([curr_id]() {threadsCollectionManager.set_as_ready(curr_id);});
-};
+}
 
 
 void switch_threads(const function<void()>& handle_curr_thread){
     total_quantums++;
-    int ret_val = sigsetjmp(threadsCollectionManager.get_current_thread().env, 1);
+    Thread& curr_thread = threadsCollectionManager.get_current_thread();
+    curr_thread.saved_sp = current_stack_pointer();
+    curr_thread.deferral_depth = deferral_depth;
+    preemption_pending = 0;
+    fpuState.save(curr_thread);
+    int ret_val = sigsetjmp(curr_thread.env, !cooperative);
     if (ret_val == 1) {
         return;
     }
+    UTHREADS_PROBE2(switch_out, curr_thread.id, total_quantums);
+    drain_wakeups();
+    threadsCollectionManager.charge_running_thread(cpu_now_ns());
+    if (scheduleLog.get_mode() == ScheduleLog::REPLAY){
+        force_recorded_thread();
+    } else if (sched_policy == UTHREAD_SCHED_RANDOM){
+        threadsCollectionManager.move_random_to_front(next_random());
+    }
     threadsCollectionManager.set_next_thread_as_running();
+    if (scheduleLog.get_mode() == ScheduleLog::RECORD){
+        scheduleLog.record(total_quantums, threadsCollectionManager.get_curr_id());
+    }
     handle_curr_thread();
-    threadsCollectionManager.get_current_thread().quantums++;
-    siglongjmp(threadsCollectionManager.get_current_thread().env,1);
+    drain_wakeups();
+    Thread& next_thread = threadsCollectionManager.get_current_thread();
+    count_quantum(next_thread, curr_thread.id);
+    UTHREADS_PROBE2(switch_in, next_thread.id, next_thread.quantums);
+    jump_to_current_thread();
+}
+
+
+void jump_to_current_thread(){
+    Thread& next_thread = threadsCollectionManager.get_current_thread();
+    if (sharedStack.needs_restore(next_thread)){
+        sharedStack.run_on_restorer_stack(restore_shared_stack);
+    }
+    resume_thread(next_thread);
+}
+
+
+void restore_shared_stack(){
+    int resident = sharedStack.get_resident();
+    if (resident != NO_RESIDENT){
+        sharedStack.evict(threadsCollectionManager.get_thread(resident));
+    }
+    Thread& next_thread = threadsCollectionManager.get_current_thread();
+    sharedStack.load(next_thread);
+    resume_thread(next_thread);
+}
+
+
+void resume_thread(Thread& thread){
+    deferral_depth = thread.deferral_depth;
+    fpuState.restore(thread);
+    siglongjmp(thread.env, 1);
 }
 
 
+
 void switch_threads_mid_quantum(const function<void()>& handle_curr_thread){
+    randomize_quantum();
     set_timer();
     switch_threads(handle_curr_thread);
 }
 
+void library_error(int code, const char *message){
+    threadsCollectionManager.get_current_thread().last_error = code;
+    errorRing.push(LIB_ERROR_MSG, message);
+}
+
+
+long cpu_now_ns(){
+    struct timespec now{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) < 0){
+        fatal_error(SYS_ERROR_MSG, ERR_CLOCK);
+    }
+    return now.tv_sec * NSECS_PER_SEC + now.tv_nsec;
+}
+
+
+void force_recorded_thread(){
+    int tid = scheduleLog.next_forced(total_quantums);
+    if (tid != NO_FORCED_THREAD && !threadsCollectionManager.move_to_front(tid)){
+        scheduleLog.diverged();
+    }
+}
+
+
+uint64_t next_random(){
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+
+void randomize_quantum(){
+    if (max_quantum_usecs > min_quantum_usecs){
+        init_timer(min_quantum_usecs + (int)(next_random() % (max_quantum_usecs - min_quantum_usecs + 1)));
+    }
+}
+
+
+int lock_mutex(bool timed, long timeout_ns){
+    mask_time_signal(SIG_BLOCK);
+    int id = threadsCollectionManager.get_curr_id();
+    if (mutex.locking_thread == id) {
+        library_error(UTHREAD_EDEADLK, MUTEX_LOCK_TWICE);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    Thread& curr_thread = threadsCollectionManager.get_current_thread();
+    curr_thread.timed_out = timed && timeout_ns <= 0;
+    if (timed && mutex.locked && !curr_thread.timed_out){
+        timerHeap.add(id, cpu_now_ns() + timeout_ns);
+    }
+    act_on_cancel();
+    while (mutex.locked && !curr_thread.timed_out){
+        UTHREADS_PROBE2(mutex_wait, id, mutex.locking_thread);
+        switch_threads_mid_quantum([id](){
+            threadsCollectionManager.wait_for_mutex(id);});
+        act_on_cancel();
+    }
+    timerHeap.cancel(id);
+    if (mutex.locked){
+        library_error(UTHREAD_ETIMEDOUT, MUTEX_TIMEOUT);
+        mask_time_signal(SIG_UNBLOCK);
+        return FAILURE;
+    }
+    mutex.locked = true;
+    mutex.locking_thread = id;
+    UTHREADS_PROBE1(mutex_acquire, id);
+    mask_time_signal(SIG_UNBLOCK);
+    return SUCCESS;
+}
+
+
+void count_quantum(Thread& thread, int switched_out){
+    thread.quantums++;
+    threadsCollectionManager.publish_quantums(thread.id);
+    if (introspection.active()){
+        introspection.begin();
+        if (switched_out != NOT_SWITCHED){
+            write_thread_record(switched_out);
+            write_thread_record(thread.id);
+        }
+        introspection.publish_quantum(thread.id, (int)thread.quantums, (long)total_quantums);
+        introspection.end();
+    }
+}
+
+
+void describe_thread(int tid, struct uthread_info& entry){
+    Thread& thread = threadsCollectionManager.get_thread(tid);
+    entry.tid = tid;
+    entry.quantums = (int)thread.quantums;
+    entry.cpu_time_ns = thread.cpu_time_ns;
+    entry.wait_reason = UTHREAD_WAIT_NONE;
+    entry.wait_target = -1;
+    if (tid == threadsCollectionManager.get_curr_id()){
+        entry.state = UTHREAD_STATE_RUNNING;
+    } else if (threadsCollectionManager.is_blocked(tid)){
+        entry.state = UTHREAD_STATE_BLOCKED;
+        entry.wait_reason = UTHREAD_WAIT_BLOCK;
+    } else if (threadsCollectionManager.is_waiting_for_mutex(tid)){
+        entry.state = UTHREAD_STATE_WAITING;
+        entry.wait_reason = timerHeap.armed(tid) ? UTHREAD_WAIT_MUTEX_TIMED : UTHREAD_WAIT_MUTEX;
+        entry.wait_target = mutex.locking_thread;
+    } else {
+        entry.state = UTHREAD_STATE_READY;
+    }
+}
+
+
+void publish_thread(int tid){
+    if (!introspection.active() || tid < 0){
+        return;
+    }
+    introspection.begin();
+    write_thread_record(tid);
+    introspection.end();
+}
+
+
+void write_thread_record(int tid){
+    if (tid < 0){
+        return;
+    }
+    struct uthread_info entry{tid, NO_THREAD_STATE, 0, 0, UTHREAD_WAIT_NONE, -1};
+    if (threadsCollectionManager.contains(tid)){
+        describe_thread(tid, entry);
+    }
+    introspection.publish_thread(entry);
+}
+
+
+void close_introspection(){
+    introspection.close();
+}
+
+
+void stop_time_signal(){
+    mask_time_signal(SIG_BLOCK);
+}
+
+
+void thread_main(){
+    mask_time_signal(SIG_UNBLOCK);
+    EntryPoint routine = threadsCollectionManager.get_current_thread().routine;
+    try {
+        routine();
+    } catch (const ThreadExit& e) {
+    } catch (...) {
+        fatal_error(LIB_ERROR_MSG, ERR_THREW);
+    }
+    mask_time_signal(SIG_BLOCK);
+    run_cleanup_handlers();
+    int tid = threadsCollectionManager.get_curr_id();
+    switch_threads_mid_quantum([tid](){ delete_thread(tid); });
+    fatal_error(LIB_ERROR_MSG, ERR_EXIT);
+}
+
+
+void exit_current_thread(){
+    run_cleanup_handlers();
+    mask_time_signal(SIG_UNBLOCK);
+    throw ThreadExit();
+}
+
+
+void run_cleanup_handlers(){
+    Thread& curr_thread = threadsCollectionManager.get_current_thread();
+    while (!curr_thread.cleanup_handlers.empty()){
+        CleanupHandler handler = pop_cleanup_handler();
+        mask_time_signal(SIG_UNBLOCK);
+        handler.routine(handler.arg);
+        mask_time_signal(SIG_BLOCK);
+    }
+}
+
+
+void delete_thread(int tid){
+    UTHREADS_PROBE1(terminate, tid);
+    threadsCollectionManager.terminate(tid);
+    publish_thread(tid);
+    timerHeap.cancel(tid);
+    if (sharedStack.get_resident() == tid){
+        sharedStack.set_resident(NO_RESIDENT);
+    }
+    if (mutex.locking_thread == tid){
+        mutex.locking_thread = -1;
+        mutex.locked = false;
+        publish_thread(threadsCollectionManager.advance_mutex_line());
+    }
+}
+
+
+void act_on_cancel(){
+    Thread& curr_thread = threadsCollectionManager.get_current_thread();
+    if (!curr_thread.cancel_requested){
+        return;
+    }
+    curr_thread.last_error = UTHREAD_ECANCELED;
+    exit_current_thread();
+}
+
+
+CleanupHandler pop_cleanup_handler(){
+    std::vector<CleanupHandler>& handlers = threadsCollectionManager.get_current_thread().cleanup_handlers;
+    CleanupHandler handler = handlers.back();
+    handlers.pop_back();
+    return handler;
+}
+
+
+void expire_wait(int id){
+    threadsCollectionManager.get_thread(id).timed_out = true;
+    threadsCollectionManager.stop_waiting_for_mutex(id);
+    publish_thread(id);
+}
+
+
+void drain_wakeups(){
+    wakeupQueue.drain([](int id){ wake_thread(id); });
+}
+
+
+int wake_thread(int tid){
+    bool was_blocked = threadsCollectionManager.is_blocked(tid);
+    if (threadsCollectionManager.resume(tid) == FAILURE){
+        return FAILURE;
+    }
+    if (was_blocked){
+        UTHREADS_PROBE1(resume, tid);
+        publish_thread(tid);
+    }
+    return SUCCESS;
+}
+
+
+void* log_flusher_main(void*){
+    while (true){
+        while (sem_wait(&log_flusher_wakeup) < 0){}
+        log_flusher_kicked.store(false, std::memory_order_relaxed);
+        bool stop = log_flusher_stop.load(std::memory_order_relaxed);
+        while (logRing.used() > 0){
+            if (!write_log()){
+                log_write_failed.store(true, std::memory_order_relaxed);
+                break;
+            }
+        }
+        if (stop){
+            return nullptr;
+        }
+    }
+}
+
+
+bool write_log(){
+    if (log_flushing.exchange(true, std::memory_order_acquire)){
+        return true;
+    }
+    struct iovec pending[2];
+    int count = logRing.pending(pending);
+    ssize_t written = 0;
+    if (count > 0){
+        while ((written = writev(log_fd.load(std::memory_order_relaxed), pending, count)) < 0 && errno == EINTR){}
+    }
+    if (written > 0){
+        logRing.consume(written);
+    }
+    log_flushing.store(false, std::memory_order_release);
+    return written >= 0;
+}
+
+
+void kick_log_flusher(){
+    if (!log_flusher_kicked.exchange(true, std::memory_order_relaxed)){
+        sem_post(&log_flusher_wakeup);
+    }
+}
+
+
+void drain_log(){
+    if (log_flusher_started){
+        log_flusher_stop.store(true, std::memory_order_relaxed);
+        sem_post(&log_flusher_wakeup);
+        pthread_join(log_flusher, nullptr);
+        log_flusher_started = false;
+    }
+    write_log();
+}
+
+
+void drain_errors(){
+    errorRing.drain(STDERR_FILENO);
+}
+
+
 void mask_time_signal(int how){
+    if (cooperative){
+        return;
+    }
     if (sigprocmask(how, &sigvtalarm, nullptr) < 0){
-        cerr << SYS_ERROR_MSG << MASK_ERROR << endl;
-        std::exit(EXIT_FAILURE);
+        fatal_error(SYS_ERROR_MSG, MASK_ERROR);
     }
 }
 
 
 void set_timer(){
+    if (cooperative){
+        return;
+    }
     if (setitimer (ITIMER_VIRTUAL, &timer, nullptr) < 0) {
-        cerr << SYS_ERROR_MSG << ERR_SIG << endl;
-        exit(EXIT_FAILURE);
+        fatal_error(SYS_ERROR_MSG, ERR_SIG);
     }
 }
 
@@ -6,8 +6,49 @@
  * Author: Aviel shtern, aviel.shtern@cs.huji.ac.il
  */
 
+#include <stddef.h>
+
 #define MAX_THREAD_NUM 100 /* maximal number of threads */
-#define STACK_SIZE 4096 /* stack size per thread (in bytes) */
+/* stack size per thread (in bytes). The timer signal frame (about 3.5KB with
+ * AVX-512 state) and the library's switch path run on the interrupted
+ * thread's stack, and so does the unwinding of an exiting thread (about 5KB
+ * for the first exit), which the timer may interrupt: 16KB leaves room for
+ * both on top of the thread's own frames. */
+#define STACK_SIZE 16384
+
+/* Scheduling policies for uthread_set_sched_policy */
+#define UTHREAD_SCHED_RR 0 /* Round-Robin (default) */
+#define UTHREAD_SCHED_RANDOM 1 /* seeded pseudo-random choice among the READY threads */
+
+/* Error codes returned by uthread_last_error */
+#define UTHREAD_EOK 0 /* no error */
+#define UTHREAD_EINVAL 1 /* invalid argument */
+#define UTHREAD_ESRCH 2 /* no such thread, or the operation is illegal for it */
+#define UTHREAD_EAGAIN 3 /* no place for more threads */
+#define UTHREAD_EDEADLK 4 /* the mutex is already locked by the calling thread */
+#define UTHREAD_EPERM 5 /* the mutex is not locked by the calling thread */
+#define UTHREAD_EIO 6 /* writing out a buffer failed */
+#define UTHREAD_ETIMEDOUT 7 /* a timed wait timed out */
+#define UTHREAD_ECANCELED 8 /* the thread was canceled (seen by its cleanup handlers) */
+
+/* Thread states and wait reasons reported by uthread_snapshot */
+#define UTHREAD_STATE_RUNNING 0
+#define UTHREAD_STATE_READY 1
+#define UTHREAD_STATE_BLOCKED 2 /* blocked by uthread_block */
+#define UTHREAD_STATE_WAITING 3 /* waiting for the mutex */
+#define UTHREAD_WAIT_NONE 0
+#define UTHREAD_WAIT_BLOCK 1 /* uthread_block */
+#define UTHREAD_WAIT_MUTEX 2 /* uthread_mutex_lock */
+#define UTHREAD_WAIT_MUTEX_TIMED 3 /* uthread_mutex_timedlock */
+
+struct uthread_info {
+    int tid;
+    int state; /* one of UTHREAD_STATE_* */
+    int quantums;
+    long cpu_time_ns;
+    int wait_reason; /* one of UTHREAD_WAIT_* */
+    int wait_target; /* the thread holding what it waits for, or -1 */
+};
 
 /* External interface */
 
@@ -22,6 +63,29 @@
 */
 int uthread_init(int quantum_usecs);
 
+/*
+ * Description: This function initializes the thread library in cooperative
+ * mode, as an alternative to uthread_init. No timer signal is used at all,
+ * so system calls are never interrupted with EINTR and no signal handler
+ * runs. A helper kernel thread advances a tick counter every quantum_usecs
+ * micro-seconds (wall clock), and threads are preempted only at safepoints:
+ * calls to uthread_maybe_yield, which switch threads if a tick passed since
+ * the last safepoint. It is an error to call this function with
+ * non-positive quantum_usecs.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_init_cooperative(int quantum_usecs);
+
+
+/*
+ * Description: This function is a safepoint for cooperative mode: if a
+ * quantum passed since the last safepoint, a scheduling decision is made
+ * exactly as the timer signal would. When not in cooperative mode it does
+ * nothing. It costs one load and compare when no quantum passed.
+*/
+void uthread_maybe_yield();
+
+
 /*
  * Description: This function creates a new thread, whose entry point is the
  * function f with the signature void f(void). The thread is added to the end
@@ -35,6 +99,292 @@ int uthread_init(int quantum_usecs);
 int uthread_spawn(void (*f)(void));
 
 
+/*
+ * Description: This function switches the library to shared-stack mode.
+ * Every thread spawned after this call runs on one shared stack of
+ * stack_size bytes instead of a private one. When such a thread is switched
+ * out and another shared-stack thread runs, the used portion of the shared
+ * stack is copied to a save buffer of the thread, and copied back before it
+ * runs again. Save buffers (stack_size bytes each) are allocated when the
+ * threads are spawned, so switching never allocates. It is an error to call this function with
+ * non-positive stack_size or more than once.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_enable_shared_stack(int stack_size);
+
+
+/*
+ * Description: This function flags the thread with ID tid as using (or not
+ * using) floating point / vector state. The FP/SSE/AVX state of flagged
+ * threads is saved and restored on every switch, other threads skip it and
+ * only get the default MXCSR and x87 control words. The main thread is
+ * flagged by default, spawned threads are not. If no thread with ID tid
+ * exists it is considered an error.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_fpu(int tid, int enabled);
+
+
+/*
+ * Description: This function pins the worker (the kernel thread running the
+ * uthreads) to the given cpu, so cache-hot threads keep running on one core.
+ * The thread control blocks move to the NUMA node of that cpu, and stacks
+ * allocated from then on are bound to (and first touched on) that node.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_pin_worker(int cpu);
+
+
+/*
+ * Description: This function makes the thread with ID tid a member of the
+ * thread group group (a positive number), or removes it from its group if
+ * group is 0. Whenever a member of a group is scheduled after a thread
+ * outside the group, the other READY members of the group are moved to the
+ * front of the READY list, so tightly coupled threads run in consecutive
+ * quantums instead of being interleaved with unrelated threads. Each member
+ * runs once per such turn, then the other threads get theirs. If no thread
+ * with ID tid exists, or group is negative, it is considered an error.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_group(int tid, int group);
+
+
+/*
+ * Description: This function makes parent the parent of the thread group
+ * group in the group hierarchy (0 makes it a root group). Threads of a group
+ * are also limited by the CPU quotas of all its ancestors. It is an error if
+ * group is not positive, parent is negative, or the change creates a cycle.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_group_set_parent(int group, int parent);
+
+
+/*
+ * Description: This function limits the threads of the thread group group
+ * (and of its descendant groups) to quota_usecs of CPU time in every
+ * period_usecs of CPU time (e.g. 20000 out of 100000). A group that used up
+ * its quota is throttled: its READY threads are skipped by the scheduler
+ * until the next period, unless no other thread can run. A quota of 0
+ * removes the limit. It is an error if group or period_usecs is not
+ * positive, or quota_usecs is negative.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_group_set_quota(int group, int quota_usecs, int period_usecs);
+
+
+/*
+ * Description: This function starts recording every scheduling decision
+ * (the quantum index and the ID of the thread switched in) to a compact
+ * binary log at path, so the same interleaving can be forced later with
+ * uthread_replay_start. It is an error to start while recording or
+ * replaying, or if the file cannot be created.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_record_start(const char *path);
+
+
+/*
+ * Description: This function starts replaying a log written by
+ * uthread_record_start: the running thread is not preempted before the
+ * quantum recorded for the next switch, and on every switch the thread
+ * recorded for that decision is scheduled next if it is READY. Decisions
+ * whose thread is not READY fall back to the normal policy, and switches
+ * that happen at another quantum than recorded (e.g. a thread blocks
+ * earlier) are followed anyway; both are counted as divergences. It
+ * is an error to start while recording or replaying, or if the file is not
+ * a valid log.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_replay_start(const char *path);
+
+
+/*
+ * Description: This function stops recording (writing the rest of the
+ * log) or replaying. It is an error to call it while neither is active.
+ * Return value: When replaying, the number of divergences. When recording,
+ * 0. On failure, return -1.
+*/
+int uthread_schedule_log_stop();
+
+
+/*
+ * Description: This function sets the scheduling policy. UTHREAD_SCHED_RR
+ * (the default) runs the READY threads in Round-Robin order.
+ * UTHREAD_SCHED_RANDOM picks the next thread from the READY threads
+ * pseudo-randomly; the sequence is determined by seed, so stress runs that
+ * shake out lock convoys and latency outliers can be reproduced. It is an
+ * error to pass an unknown policy.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_sched_policy(int policy, unsigned int seed);
+
+
+/*
+ * Description: This function makes the length of every quantum a
+ * pseudo-random number of micro-seconds in [min_usecs, max_usecs] (drawn
+ * from the generator seeded by uthread_set_sched_policy) instead of the
+ * fixed quantum_usecs given to uthread_init. Passing min_usecs == max_usecs
+ * returns to a fixed quantum. In cooperative mode the range applies to
+ * the ticker's wall-clock quanta. It is an error if min_usecs is not
+ * positive or max_usecs < min_usecs.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_quantum_range(int min_usecs, int max_usecs);
+
+
+/*
+ * Description: This function registers a restartable critical section: the
+ * code in [start, end). If the timer preempts a thread while its program
+ * counter is inside the section, the thread continues at abort when it runs
+ * again, instead of after the interrupted instruction. A section that reads
+ * per-worker data and publishes its update with its last instruction (the
+ * one right before end) can therefore run without locks or signal masking:
+ * the abort code simply retries it. Sections are usually delimited with
+ * local labels in inline assembly. It is an error if start >= end, abort is
+ * NULL, or 32 sections are already registered.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_register_restartable(void *start, void *end, void *abort);
+
+
+/*
+ * Description: This function marks the start of a region of the calling
+ * thread in which it must not be preempted, e.g. a call into malloc,
+ * iostream or other non-reentrant code. A timer tick that falls inside the
+ * region does not switch threads; the switch is made when the region ends
+ * (uthread_allow_preemption). Regions nest. Unlike masking the timer signal
+ * this costs no system call. Blocking calls made inside the region still
+ * switch threads.
+*/
+void uthread_defer_preemption();
+
+
+/*
+ * Description: This function ends a region started with
+ * uthread_defer_preemption. When the outermost region ends and a switch was
+ * deferred meanwhile, a scheduling decision is made right away. Calling it
+ * outside a region has no effect.
+*/
+void uthread_allow_preemption();
+
+
+/*
+ * Description: This function registers the code in [start, end) (e.g. the
+ * text of a non-reentrant library function) as non-preemptible: a timer tick
+ * that interrupts a thread inside it does not switch threads, and the thread
+ * is preempted on the next tick instead. It is an error if start >= end, or
+ * 32 sections and ranges are already registered.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_register_nonpreemptible(void *start, void *end);
+
+
+/*
+ * Description: This function allocates size bytes from the worker-local slab
+ * allocator. Small blocks (up to 2048 bytes) come from per-size-class free
+ * lists, so allocation-heavy threads get thread-cache speed. The call defers
+ * preemption internally, so it is safe without masking signals and never
+ * leaves the allocator half updated when the timer fires.
+ * Return value: A 16-byte aligned block, or NULL if out of memory.
+*/
+void* uthread_malloc(size_t size);
+
+
+/*
+ * Description: This function releases a block returned by uthread_malloc.
+ * Passing NULL has no effect. Like uthread_malloc it is preemption-safe.
+*/
+void uthread_free(void *ptr);
+
+
+/*
+ * Description: This function appends a log record (len bytes, usually a
+ * line ending with a newline) to the worker's log buffer. It never blocks
+ * and never makes a system call: the record is copied into a ring buffer
+ * with preemption deferred, so records are never torn by a thread switch.
+ * The buffer is written out by uthread_log_flush, by the flusher thread
+ * (uthread_log_start_flusher) and at exit. If the buffer is full the record
+ * is dropped.
+ * Return value: On success, return 0. If the record was dropped, return -1.
+*/
+int uthread_log(const char *message, size_t len);
+
+
+/*
+ * Description: This function writes the buffered log records to the log fd
+ * (stdout unless set with uthread_log_set_fd) with one writev. Without a
+ * flusher the write is made by the calling thread, and since all threads
+ * share one kernel thread, the whole scheduler waits for it. With a flusher
+ * running (uthread_log_start_flusher) the flusher is woken to write the
+ * buffer and the call returns at once.
+ * Return value: On success, return 0. On failure (including a failed write
+ * of the flusher since the last call), return -1.
+*/
+int uthread_log_flush();
+
+
+/*
+ * Description: This function starts a helper kernel thread that writes the
+ * log buffer out whenever it is more than half full or uthread_log_flush
+ * is called. The writes block only the helper, so neither the threads that
+ * log nor the scheduler ever wait for them. The helper blocks every signal.
+ * It is an error to start it twice, or if the helper cannot be started.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_log_start_flusher();
+
+
+/*
+ * Description: This function sets the file descriptor the log buffer is
+ * written to (stdout by default).
+*/
+void uthread_log_set_fd(int fd);
+
+
+/*
+ * Description: This function requests cancellation of the thread with ID
+ * tid. The thread is woken from any blocking call (a mutex wait, a timed
+ * wait or being blocked) and acts on the request at its next cancellation
+ * point: uthread_mutex_lock, uthread_mutex_timedlock, uthread_block of
+ * itself, or uthread_testcancel. There, on its own stack, its last error is
+ * set to UTHREAD_ECANCELED, its cleanup handlers run (most recently pushed
+ * first), its stack is unwound (see uthread_exit) and it terminates,
+ * releasing the mutex if it holds it. A thread that cancels itself does so
+ * right away. If no thread with ID tid exists,
+ * or tid is 0, it is considered an error.
+ * Return value: On success, return 0. On failure, return -1. If a thread
+ * cancels itself, the function does not return.
+*/
+int uthread_cancel(int tid);
+
+
+/*
+ * Description: This function registers a cleanup handler for the calling
+ * thread: routine(arg) runs if the thread is canceled or terminates itself
+ * (including by returning from its entry function). Handlers run in the
+ * reverse order of their registration.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_cleanup_push(void (*routine)(void *), void *arg);
+
+
+/*
+ * Description: This function removes the most recently pushed cleanup
+ * handler of the calling thread, and runs it if execute is non-zero. It is
+ * an error to call it when no handler is registered.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_cleanup_pop(int execute);
+
+
+/*
+ * Description: This function is a cancellation point: if cancellation of
+ * the calling thread was requested, it runs the thread's cleanup handlers
+ * and terminates it (see uthread_cancel). Otherwise it returns immediately.
+*/
+void uthread_testcancel();
+
+
 /*
  * Description: This function terminates the thread with ID tid and deletes
  * it from all relevant control structures. All the resources allocated by
@@ -44,11 +394,27 @@ int uthread_spawn(void (*f)(void));
  * exit(0) [after releasing the assigned library memory].
  * Return value: The function returns 0 if the thread was successfully
  * terminated and -1 otherwise. If a thread terminates itself or the main
- * thread is terminated, the function does not return.
+ * thread is terminated, the function does not return. A thread that
+ * terminates itself runs its cleanup handlers and is unwound first (see
+ * uthread_exit).
 */
 int uthread_terminate(int tid);
 
 
+/*
+ * Description: This function terminates the calling thread, like
+ * uthread_terminate with its own ID: the thread's cleanup handlers run
+ * (most recently pushed first), then its stack is unwound, so the
+ * destructors of its C++ objects run, and it is then released. Called by
+ * the main thread, it exits the process. A thread whose entry function
+ * returns exits the same way (its frames are already gone). The unwinding
+ * is a C++ exception: code on a thread that catches every exception
+ * (catch (...)) must rethrow it.
+ * Return value: The function does not return.
+*/
+void uthread_exit();
+
+
 /*
  * Description: This function blocks the thread with ID tid. The thread may
  * be resumed later using uthread_resume. If no thread with ID tid exists it
@@ -71,6 +437,34 @@ int uthread_block(int tid);
 int uthread_resume(int tid);
 
 
+/*
+ * Description: This function posts a resume request for the thread with ID
+ * tid. Unlike uthread_resume it may be called from any kernel thread (e.g.
+ * a callback thread of another library) and from signal handlers: it only
+ * sets a flag with one atomic operation and kicks the eventfd returned by
+ * uthread_wakeup_fd. The request is carried out like uthread_resume on the
+ * next scheduling point (thread switch or timer tick). Requests for threads
+ * that do not exist by then are ignored. Other kernel threads of the process
+ * should block SIGVTALRM, so the timer signal is always delivered to the
+ * library's thread.
+ * Return value: On success, return 0. If tid is out of range, return -1.
+*/
+int uthread_resume_async(int tid);
+
+
+/*
+ * Description: This function returns an eventfd that becomes readable when
+ * uthread_resume_async is called, so a thread that waits in poll/epoll for
+ * external events can notice the wakeup. The eventfd is created on the
+ * first call; until then posts do not write to it. It is only a hook for the
+ * caller's event loop: the library never reads it, so the caller must read
+ * it (8 bytes) when it becomes readable, or it stays readable. If it can't
+ * be created, it is considered an error.
+ * Return value: On success, return the eventfd. On failure, return -1.
+*/
+int uthread_wakeup_fd();
+
+
 /*
  * Description: This function tries to acquire a mutex. 
  * If the mutex is unlocked, it locks it and returns. 
@@ -82,6 +476,21 @@ int uthread_resume(int tid);
 int uthread_mutex_lock();
 
 
+/*
+ * Description: This function tries to acquire the mutex like
+ * uthread_mutex_lock, but gives up if it is not acquired within
+ * timeout_usecs micro-seconds of CPU time of the kernel thread that runs
+ * the threads (CLOCK_THREAD_CPUTIME_ID, so time spent in other kernel
+ * threads of the process does not count). Deadlines are checked on every
+ * quantum, so the wait may last up to one quantum longer. A non-positive
+ * timeout only tries once. If the mutex is already locked by this thread,
+ * it is considered an error.
+ * Return value: On success, return 0. On failure or timeout, return -1
+ * (uthread_last_error tells UTHREAD_ETIMEDOUT apart).
+*/
+int uthread_mutex_timedlock(int timeout_usecs);
+
+
 /*
  * Description: This function releases a mutex. 
  * If there are blocked threads waiting for this mutex, 
@@ -122,5 +531,80 @@ int uthread_get_total_quantums();
 */
 int uthread_get_quantums(int tid);
 
+
+/*
+ * Description: This function copies the number of quantums of every thread
+ * ID below n (and below MAX_THREAD_NUM) to out in one pass: out[tid] is the
+ * number of quantums of the thread with ID tid, or -1 if no such thread
+ * exists. Like uthread_get_quantums, it only reads counters the library
+ * publishes atomically, without masking the timer signal. It is an error
+ * to call it with a negative n or a null out.
+ * Return value: On success, return the number of entries written.
+ * On failure, return -1.
+*/
+int uthread_get_all_quantums(int *out, int n);
+
+
+/*
+ * Description: This function describes up to n threads, in increasing ID
+ * order, in one pass with the timer signal masked, so the entries are
+ * consistent with each other: for each thread its ID, state, number of
+ * quantums, CPU time and, unless it is running or ready, why it waits and
+ * for which thread (the holder of the mutex it waits for, or -1). It does
+ * not allocate memory. It is an error to call it with a negative n or a
+ * null info.
+ * Return value: On success, return the number of entries written. On
+ * failure, return -1.
+*/
+int uthread_snapshot(struct uthread_info *info, int n);
+
+
+/*
+ * Description: This function starts publishing the state of the library to
+ * a POSIX shared-memory object named /uthreads.<pid>, for tools in other
+ * processes (uthread-top <pid> renders it). Each thread's state, quantums
+ * and CPU time, the running thread and the total number of quantums are
+ * published as they change, under a sequence lock, at the cost of a few
+ * stores per context switch. The object is removed when publishing stops
+ * or the process exits. It is an error to call this function while
+ * publishing, or if the object can't be created (UTHREAD_EIO).
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_introspection_start();
+
+
+/*
+ * Description: This function stops publishing and removes the
+ * shared-memory object. It is an error to call it when not publishing.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_introspection_stop();
+
+
+/*
+ * Description: This function returns the error code (one of UTHREAD_E*) of
+ * the last library call of the calling thread that failed, or UTHREAD_EOK
+ * if none of its calls failed yet.
+ * Return value: The error code.
+*/
+int uthread_last_error();
+
+
+/*
+ * Description: This function writes the pending library error reports to
+ * stderr. Failing calls only record their report in a preallocated ring,
+ * the reports are written when this function is called, on the next timer
+ * tick (unless disabled with uthread_set_error_drain) and at exit.
+ * Return value: The number of reports that were lost because the ring was full.
+*/
+int uthread_flush_errors();
+
+
+/*
+ * Description: This function enables (or disables) writing the pending
+ * library error reports to stderr on the timer tick. It is enabled by default.
+*/
+void uthread_set_error_drain(int enabled);
+
 #endif
 